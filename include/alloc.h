@@ -0,0 +1,155 @@
+#pragma once
+#include "benchmark.h"
+#include "queue.h"
+#include <cstdlib>
+#include <vector>
+
+// allocation tests, defined in benchmark.cpp
+DECLARE_int32(alloc_medium_percent);
+DECLARE_int32(alloc_remote_percent);
+
+// A task allocating and freeing alloc_n blocks, step_n of them between two yields of its
+// scheduler. Blocks are small (16-256B) or, for --alloc_medium_percent of them, medium
+// (1-64KB). A task keeps its last live_n blocks; of the ones it drops,
+// --alloc_remote_percent go to an exchange queue and are freed by the task popping them,
+// on whatever worker that one runs. One malloc in sample_every is timed.
+struct alloc_task_t {
+  static const int live_n = 16;
+  static const int step_n = 64;
+  static const int sample_every = 64;
+
+  alloc_task_t(uint64_t alloc_n, uint64_t seed) : alloc_left(alloc_n), random(seed | 1) {
+    std::fill(live, live + live_n, nullptr);
+    latencies.reserve(alloc_n / sample_every + 1);
+  }
+
+  // run step_n rounds, return false when done
+  bool step(mpmc_queue_t<void *> &exchange) {
+    for (int i = 0; i < step_n && alloc_left > 0; ++i, --alloc_left) {
+      auto &slot = live[alloc_left % live_n];
+      if (slot) {
+        drop(slot, exchange);
+      }
+      slot = allocate();
+
+      void *remote;
+      if (exchange.pop(remote)) {
+        free(remote);
+      }
+    }
+    if (alloc_left > 0) {
+      return true;
+    }
+    for (auto &slot : live) {
+      if (slot) {
+        free(slot);
+        slot = nullptr;
+      }
+    }
+    return false;
+  }
+
+  void *allocate() {
+    auto percent = next() % 100;
+    auto size = int(percent) < FLAGS_alloc_medium_percent ? 1024 + next() % (63 * 1024)
+                                                          : 16 + next() % 240;
+    void *block;
+    if (alloc_left % sample_every == 0) {
+      auto malloc_before = clk::now();
+      block = malloc(size);
+      latencies.push_back(clk::now() - malloc_before);
+    } else {
+      block = malloc(size);
+    }
+    // touch it, so that the block is backed by memory
+    static_cast<char *>(block)[0] = 1;
+    return block;
+  }
+
+  void drop(void *block, mpmc_queue_t<void *> &exchange) {
+    if (int(next() % 100) < FLAGS_alloc_remote_percent && exchange.push(block)) {
+      return;
+    }
+    free(block);
+  }
+
+  // xorshift, cheap and per task
+  uint64_t next() {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    return random;
+  }
+
+  uint64_t alloc_left;
+  uint64_t random;
+  void *live[live_n];
+  std::vector<ns> latencies;
+};
+
+// The tasks of one allocation test, their exchange queue, and the throughput, memory and
+// lock sleeps around them. Allocator locks aren't observable from outside, so contention
+// shows as voluntary context switches (sleeps on a futex) and as the malloc tail latency.
+struct alloc_run_t {
+  alloc_run_t(int task_n, uint64_t alloc_n) : exchange(65536), alloc_total(task_n * alloc_n) {
+    tasks.reserve(task_n);
+    for (int i = 0; i < task_n; ++i) {
+      tasks.emplace_back(alloc_n, i + 1);
+    }
+  }
+
+  void start() {
+    rss_before = Utils::rss_kb();
+    allocated_before = Utils::allocated_bytes();
+    switches_before = Utils::voluntary_switches();
+    run_before = clk::now();
+  }
+
+  // free what is left in the exchange, part of the measured region
+  void stop() {
+    void *remote;
+    while (exchange.pop(remote)) {
+      free(remote);
+    }
+    run_after = clk::now();
+    switches_after = Utils::voluntary_switches();
+  }
+
+  void print(int task_n) {
+    auto run_us = std::chrono::duration_cast<us>(run_after - run_before).count();
+    fmt::print("{} tasks on {}: {} mallocs, cost {} us, {:.0f} mallocs/s, rss {:+} KB, "
+               "allocated {:+} bytes, {} voluntary switches\n",
+               task_n, Utils::allocator_name(), alloc_total, run_us,
+               alloc_total * 1e6 / std::max<long>(run_us, 1), Utils::rss_kb() - rss_before,
+               int64_t(Utils::allocated_bytes()) - int64_t(allocated_before),
+               switches_after - switches_before);
+    std::vector<ns> latencies;
+    for (auto &task : tasks) {
+      latencies.insert(latencies.end(), task.latencies.begin(), task.latencies.end());
+    }
+    Utils::print_latency("malloc", latencies);
+  }
+
+  mpmc_queue_t<void *> exchange;
+  std::vector<alloc_task_t> tasks;
+  uint64_t alloc_total;
+  long rss_before = 0;
+  size_t allocated_before = 0;
+  long switches_before = 0;
+  long switches_after = 0;
+  time_point_t run_before, run_after;
+};
+
+// a void *(*)(void *) task running one alloc_task_t, yielding with Yield between steps
+struct args_alloc_t {
+  alloc_task_t *task;
+  mpmc_queue_t<void *> *exchange;
+};
+
+template <void (*Yield)()> void *f_alloc(void *args) {
+  auto args_alloc = static_cast<args_alloc_t *>(args);
+  while (args_alloc->task->step(*args_alloc->exchange)) {
+    Yield();
+  }
+  return nullptr;
+}
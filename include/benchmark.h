@@ -1,5 +1,29 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fmt/core.h>
+#include <gflags/gflags.h>
+#include <malloc.h>
+#include <gperftools/profiler.h>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/sysinfo.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 // global definitions start
 using clk = std::chrono::system_clock;
 using ms = std::chrono::milliseconds;
@@ -8,6 +32,34 @@ using ns = std::chrono::nanoseconds;
 using s = std::chrono::seconds;
 using time_point_t = decltype(clk::now());
 
+// pipeline tests: items are stamped by the source and checked by the sink
+struct pipeline_item_t {
+  uint64_t seq;
+  uint64_t value; // the seq, transformed by every stage
+  time_point_t born;
+};
+using batch_t = std::vector<pipeline_item_t>;
+
+// stack fault tests: a task probes how many pages of its stack are resident
+struct stack_probe_t {
+  size_t stack_size;
+  size_t pages;
+};
+
+// oversubscription tests: a task spins for work_n iterations, then records the time
+// since it was submitted
+struct spin_task_t {
+  uint64_t work_n;
+  time_point_t born;
+  ns latency;
+};
+
+// false sharing tests: a task increments its own counter write_n times
+struct sharing_args_t {
+  uint32_t *counter;
+  uint64_t write_n;
+};
+
 struct Utils {
   static void *f_null(void *) { return nullptr; }
   static void *f_mul_1(void *value) {
@@ -32,8 +84,778 @@ struct Utils {
     }
     return value;
   }
+
+  // a task body that uses 16K of stack, then probes how much of its stack is resident
+  static void *f_touch_stack(void *probe) {
+    volatile char buffer[16 * 1024];
+    for (size_t i = 0; i < sizeof(buffer); i += 512) {
+      buffer[i] = 1;
+    }
+    auto stack_probe = static_cast<stack_probe_t *>(probe);
+    stack_probe->pages = stack_resident_pages(stack_probe->stack_size);
+    return nullptr;
+  }
+
+  // count resident pages from the caller's frame up to the top of its stack,
+  // stopping at the first hole (a guard page or the end of the mapping).
+  __attribute__((noinline)) static size_t stack_resident_pages(size_t stack_size) {
+    static const size_t page = sysconf(_SC_PAGESIZE);
+    char marker;
+    auto addr = reinterpret_cast<uintptr_t>(&marker) & ~(page - 1);
+    size_t pages = 0;
+    unsigned char resident = 0;
+    while (pages * page < stack_size &&
+           mincore(reinterpret_cast<void *>(addr + pages * page), page, &resident) == 0 &&
+           (resident & 1)) {
+      ++pages;
+    }
+    return pages;
+  }
+
+  // keep a value alive and force memory to be re-read, without emitting code
+  template <typename T> static void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  // a spin-wait hint; unlike a sleep, no coroutine library can hook it into a switch
+  static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  // A small id per kernel thread that is never reused, unlike pthread_self(). Not
+  // inlined, so that a caller switched to another worker in between does not reuse the
+  // thread_local address computed before the switch.
+  __attribute__((noinline)) static int worker_id() {
+    static std::atomic<int> worker_next{0};
+    static thread_local int id = worker_next++;
+    return id;
+  }
+
+  // resident set size of the process in KB
+  static long rss_kb() {
+    long pages = 0, resident = 0;
+    auto statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+      if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+      }
+      fclose(statm);
+    }
+    return resident * sysconf(_SC_PAGESIZE) / 1024;
+  }
+
+  // Bytes allocated by the application and not yet freed, from whichever malloc is in
+  // use: linked or preloaded tcmalloc or jemalloc are looked up at runtime, glibc
+  // otherwise.
+  static size_t allocated_bytes() {
+    size_t bytes = 0;
+    if (auto tc_property = tcmalloc_property()) {
+      tc_property("generic.current_allocated_bytes", &bytes);
+    } else if (auto je_mallctl = jemalloc_mallctl()) {
+      // stats are refreshed by writing the epoch
+      uint64_t epoch = 1;
+      size_t size = sizeof(epoch);
+      je_mallctl("epoch", &epoch, &size, &epoch, size);
+      size = sizeof(bytes);
+      je_mallctl("stats.allocated", &bytes, &size, nullptr, 0);
+    } else {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+      auto info = mallinfo2();
+      bytes = info.uordblks + info.hblkhd;
+#else
+      auto info = mallinfo();
+      bytes = size_t(unsigned(info.uordblks)) + size_t(unsigned(info.hblkhd));
+#endif
+    }
+    return bytes;
+  }
+
+  static const char *allocator_name() {
+    return tcmalloc_property() ? "tcmalloc" : jemalloc_mallctl() ? "jemalloc" : "glibc";
+  }
+
+  using tcmalloc_property_t = int (*)(const char *, size_t *);
+  static tcmalloc_property_t tcmalloc_property() {
+    static auto property = reinterpret_cast<tcmalloc_property_t>(
+        dlsym(RTLD_DEFAULT, "MallocExtension_GetNumericProperty"));
+    return property;
+  }
+
+  using jemalloc_mallctl_t = int (*)(const char *, void *, size_t *, void *, size_t);
+  static jemalloc_mallctl_t jemalloc_mallctl() {
+    static auto mallctl = reinterpret_cast<jemalloc_mallctl_t>(dlsym(RTLD_DEFAULT, "mallctl"));
+    return mallctl;
+  }
+
+  // CPUs the process may run on: its affinity mask, capped by the CFS quota (cgroup v2
+  // cpu.max) of its cgroup. Use this, not hardware_concurrency(), to size workers.
+  static int cpu_count() {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int cpu_n = std::thread::hardware_concurrency();
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+      cpu_n = CPU_COUNT(&cpus);
+    }
+    long quota = 0, period = 0;
+    auto cpu_max = fopen((cgroup_dir() + "/cpu.max").c_str(), "r");
+    if (cpu_max) {
+      if (fscanf(cpu_max, "%ld %ld", &quota, &period) == 2 && quota > 0 && period > 0) {
+        cpu_n = std::min<long>(cpu_n, (quota + period - 1) / period);
+      }
+      fclose(cpu_max);
+    }
+    return std::max(cpu_n, 1);
+  }
+
+  // restrict the process to the first cpu_n CPUs of its affinity mask, call it before
+  // any worker is started since only later threads inherit the mask
+  static bool restrict_cpus(int cpu_n) {
+    cpu_set_t cpus, restricted;
+    CPU_ZERO(&restricted);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0) {
+      return false;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && CPU_COUNT(&restricted) < cpu_n; ++cpu) {
+      if (CPU_ISSET(cpu, &cpus)) {
+        CPU_SET(cpu, &restricted);
+      }
+    }
+    return sched_setaffinity(0, sizeof(restricted), &restricted) == 0;
+  }
+
+  // Emulate a container's CPU quota: move the process into a new child of its cgroup
+  // with cpu.max of percent% of one CPU. Needs a writable cgroup v2 hierarchy with the
+  // cpu controller delegated, returns false otherwise.
+  static bool limit_cpu_quota(int percent) {
+    auto dir = cgroup_dir() + "/co-benchmark-" + std::to_string(getpid());
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    return write_file(dir + "/cpu.max", std::to_string(percent * 1000) + " 100000") &&
+           write_file(dir + "/cgroup.procs", std::to_string(getpid()));
+  }
+
+  // the cgroup v2 directory of the process
+  static std::string cgroup_dir() {
+    std::string dir = "/sys/fs/cgroup";
+    char line[4096];
+    auto cgroup = fopen("/proc/self/cgroup", "r");
+    if (!cgroup) {
+      return dir;
+    }
+    while (fgets(line, sizeof(line), cgroup)) {
+      std::string entry(line);
+      if (entry.compare(0, 3, "0::") == 0) {
+        dir += entry.substr(3, entry.find_last_not_of('\n') - 2);
+        break;
+      }
+    }
+    fclose(cgroup);
+    return dir;
+  }
+
+  static bool write_file(const std::string &path, const std::string &content) {
+    auto file = fopen(path.c_str(), "w");
+    if (!file) {
+      return false;
+    }
+    bool written = fputs(content.c_str(), file) >= 0;
+    return fclose(file) == 0 && written;
+  }
+
+  // workers of the oversubscription sweep: 0.5x, 1x, 2x and 8x the allowed CPUs
+  static std::vector<int> oversubscribed_workers() {
+    auto cpu_n = cpu_count();
+    std::vector<int> workers{std::max(cpu_n / 2, 1), cpu_n, cpu_n * 2, cpu_n * 8};
+    workers.erase(std::unique(workers.begin(), workers.end()), workers.end());
+    return workers;
+  }
+
+  // involuntary context switches of the whole process so far
+  static long involuntary_switches() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nivcsw;
+  }
+
+  // voluntary context switches of the whole process so far, e.g. sleeps on a lock
+  static long voluntary_switches() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+  }
+
+  // minor page faults of the whole process so far
+  static long minor_faults() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt;
+  }
+
+  static void *f_spin(void *task) {
+    auto spin_task = static_cast<spin_task_t *>(task);
+    for (uint64_t i = 0; i < spin_task->work_n; ++i) {
+      do_not_optimize(i);
+    }
+    spin_task->latency = std::chrono::duration_cast<ns>(clk::now() - spin_task->born);
+    return nullptr;
+  }
+
+  static void *f_write(void *args) {
+    auto sharing_args = static_cast<sharing_args_t *>(args);
+    for (uint64_t i = 0; i < sharing_args->write_n; ++i) {
+      ++*sharing_args->counter;
+      do_not_optimize(*sharing_args->counter);
+    }
+    return nullptr;
+  }
+
+  // a task that counts itself done
+  static void *f_count(void *counter) {
+    static_cast<std::atomic<int> *>(counter)->fetch_add(1);
+    return nullptr;
+  }
+
+  // task counts of the join tests: 10, 100, ... up to max_n
+  static std::vector<int> join_sizes(int max_n) {
+    std::vector<int> sizes;
+    for (long task_n = 10; task_n <= max_n; task_n *= 10) {
+      sizes.push_back(task_n);
+    }
+    return sizes;
+  }
+
+  static void print_join(const char *primitive, int task_n, ns launch, ns join) {
+    fmt::print("join {} tasks with {}: launch cost {} us, join cost {} us, {} ns per task\n",
+               task_n, primitive, std::chrono::duration_cast<us>(launch).count(),
+               std::chrono::duration_cast<us>(join).count(),
+               (launch + join).count() / std::max(task_n, 1));
+  }
+
+  static size_t avg_stack_pages(const std::vector<stack_probe_t> &probes) {
+    size_t pages = 0;
+    for (auto &probe : probes) {
+      pages += probe.pages;
+    }
+    return probes.empty() ? 0 : pages / probes.size();
+  }
+
+  // the small transform each pipeline stage applies to an item
+  static pipeline_item_t op_stage(pipeline_item_t item) {
+    item.value = item.value * 10 + 1;
+    return item;
+  }
+
+  // sorts latencies in place, then prints avg, p50, p99 and max
+  static void print_latency(const char *what, std::vector<ns> &latencies) {
+    if (latencies.empty()) {
+      return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto sum = ns{0};
+    for (auto latency : latencies) {
+      sum += latency;
+    }
+    auto n = latencies.size();
+    fmt::print("{} latency: avg {} ns, p50 {} ns, p99 {} ns, max {} ns\n", what,
+               sum.count() / n, latencies[n / 2].count(), latencies[n * 99 / 100].count(),
+               latencies[n - 1].count());
+  }
 };
 
+// The sink of a pipeline test: the end-to-end latency of every item, and a check that the
+// items came in order and went through the transform of each of the stage_n stages.
+struct pipeline_sink_t {
+  pipeline_sink_t(int stage_n, int item_n) : stage_n(stage_n) { latencies.reserve(item_n); }
+
+  void take(const pipeline_item_t &item, time_point_t died) {
+    latencies.push_back(died - item.born);
+    auto expected = pipeline_item_t{item.seq, item.seq, item.born};
+    for (int i = 0; i < stage_n; ++i) {
+      expected = Utils::op_stage(expected);
+    }
+    wrong_n += item.seq != seq_next || item.value != expected.value;
+    seq_next = item.seq + 1;
+  }
+
+  void print(int item_n) {
+    if (latencies.size() != size_t(item_n) || wrong_n > 0) {
+      fmt::print("the sink got {} of {} items, {} out of order or mistransformed\n",
+                 latencies.size(), item_n, wrong_n);
+    }
+    Utils::print_latency("end-to-end item", latencies);
+  }
+
+  int stage_n;
+  std::vector<ns> latencies;
+  uint64_t seq_next = 0;
+  uint64_t wrong_n = 0;
+};
+
+// tls tests: storages with set() and get(), shared by all libraries.
+struct thread_local_storage_t {
+  // not inlined, for the same reason as Utils::worker_id
+  __attribute__((noinline)) static uint64_t &slot() {
+    static thread_local uint64_t slot = 0;
+    return slot;
+  }
+  void set(uint64_t value) { slot() = value; }
+  uint64_t get() { return slot(); }
+};
+
+struct pthread_specific_storage_t {
+  static pthread_key_t key() {
+    static pthread_key_t key = []() {
+      pthread_key_t key;
+      pthread_key_create(&key, nullptr);
+      return key;
+    }();
+    return key;
+  }
+  void set(uint64_t value) { pthread_setspecific(key(), reinterpret_cast<void *>(value)); }
+  uint64_t get() { return reinterpret_cast<uint64_t>(pthread_getspecific(key())); }
+};
+
+// Per task and storage: the cost of access_n sets before a yield and access_n gets
+// after it, how often the yield migrated the task to another worker, and how often
+// the task got back a value it did not set.
+struct tls_stat_t {
+  template <typename Storage>
+  void set_phase(Storage storage, uint64_t value, uint64_t access_n) {
+    auto set_before = clk::now();
+    for (uint64_t i = 0; i < access_n; ++i) {
+      storage.set(value);
+      Utils::do_not_optimize(i);
+    }
+    set_cost += std::chrono::duration_cast<ns>(clk::now() - set_before);
+    worker = Utils::worker_id();
+  }
+
+  template <typename Storage>
+  void get_phase(Storage storage, uint64_t value, uint64_t access_n) {
+    migrated += worker != Utils::worker_id();
+    auto get_before = clk::now();
+    auto seen = storage.get();
+    for (uint64_t i = 1; i < access_n; ++i) {
+      Utils::do_not_optimize(storage.get());
+    }
+    get_cost += std::chrono::duration_cast<ns>(clk::now() - get_before);
+    stale += seen != value;
+    access_total += access_n;
+    ++round_n;
+  }
+
+  template <typename Storage, typename Yield>
+  void round(Storage storage, uint64_t value, uint64_t access_n, Yield yield) {
+    set_phase(storage, value, access_n);
+    yield();
+    get_phase(storage, value, access_n);
+  }
+
+  void merge(const tls_stat_t &other) {
+    set_cost += other.set_cost;
+    get_cost += other.get_cost;
+    access_total += other.access_total;
+    round_n += other.round_n;
+    migrated += other.migrated;
+    stale += other.stale;
+  }
+
+  void print(const char *storage) const {
+    auto access = double(std::max<uint64_t>(access_total, 1));
+    fmt::print("{}: set {:.2f} ns, get {:.2f} ns, {} of {} rounds migrated, {} stale\n",
+               storage, set_cost.count() / access, get_cost.count() / access, migrated,
+               round_n, stale);
+  }
+
+  ns set_cost{0};
+  ns get_cost{0};
+  uint64_t access_total = 0;
+  int round_n = 0;
+  int migrated = 0;
+  int stale = 0;
+  int worker = 0;
+};
+
+// Forces the yield of a tls round to migrate: before yielding, the task starts a holder
+// on its own worker, which spins on that worker until the task has resumed elsewhere; a
+// sleep would be hooked by libgo into a switch and free the worker. The hold is bounded
+// for when no other worker is free to steal the task; such a round is counted as not
+// migrated.
+struct tls_migrate_t {
+  void hold(ns hold_max) const {
+    auto hold_until = clk::now() + hold_max;
+    while (!resumed.load(std::memory_order_acquire) && clk::now() < hold_until) {
+      Utils::cpu_relax();
+    }
+  }
+
+  std::atomic<bool> resumed{false};
+};
+
+// loop test 1, defined in benchmark.cpp
+DECLARE_string(loop_layout);
+
+// The outputs of loop test 1 in the layout of --loop_layout:
+//   packed: one int per task, 16 tasks share a cache line
+//   padded: one cache line per task
+//   local:  tasks append their results to a buffer of their worker, merged after join
+// so that the multi-threaded backends don't pay for false sharing the others never see.
+// A thread takes its buffer under a mutex the first time and hands it back when it exits,
+// so the pthread backend, where every task is a thread, pays that mutex per task and
+// keeps a buffer per thread alive at a time rather than one per task.
+struct loop_layout_t {
+  using buffer_t = std::vector<std::pair<int *, int>>;
+
+  explicit loop_layout_t(int task_n)
+      : layout(FLAGS_loop_layout),
+        stride(layout == "padded" ? cache_line_size / sizeof(int) : 1),
+        datas(task_n * stride, 10) {}
+
+  int *data(int i) { return &datas[i * stride]; }
+
+  void *(*task())(void *) { return layout == "local" ? f_mul_1_local : Utils::f_mul_1; }
+
+  // apply the results buffered by the workers, part of the measured region
+  void merge() {
+    if (layout != "local") {
+      return;
+    }
+    std::lock_guard<std::mutex> guard(local_state().mutex);
+    for (auto &buffer : local_state().buffers) {
+      for (auto &result : *buffer) {
+        *result.first = result.second;
+      }
+      buffer->clear();
+    }
+  }
+
+  std::vector<int> values() const {
+    std::vector<int> packed;
+    for (size_t i = 0; i < datas.size(); i += stride) {
+      packed.push_back(datas[i]);
+    }
+    return packed;
+  }
+
+  // Not inlined, so that a migrated coroutine finds the buffer of its current worker.
+  __attribute__((noinline)) static void *f_mul_1_local(void *value) {
+    auto &buffer = local_buffer().buffer;
+    if (!buffer) {
+      buffer = take_buffer();
+    }
+    buffer->emplace_back(static_cast<int *>(value), *static_cast<int *>(value) * 10);
+    return nullptr;
+  }
+
+  struct local_state_t {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<buffer_t>> buffers;
+    std::vector<buffer_t *> free_buffers; // of exited threads, results kept until merged
+  };
+
+  static local_state_t &local_state() {
+    static local_state_t state;
+    return state;
+  }
+
+  static buffer_t *take_buffer() {
+    std::lock_guard<std::mutex> guard(local_state().mutex);
+    auto &state = local_state();
+    if (!state.free_buffers.empty()) {
+      auto buffer = state.free_buffers.back();
+      state.free_buffers.pop_back();
+      return buffer;
+    }
+    state.buffers.emplace_back(new buffer_t());
+    return state.buffers.back().get();
+  }
+
+  // returns the buffer of an exiting thread to the next thread started
+  struct buffer_owner_t {
+    ~buffer_owner_t() {
+      if (buffer) {
+        std::lock_guard<std::mutex> guard(local_state().mutex);
+        local_state().free_buffers.push_back(buffer);
+      }
+    }
+    buffer_t *buffer = nullptr;
+  };
+
+  static buffer_owner_t &local_buffer() {
+    static thread_local buffer_owner_t owner;
+    return owner;
+  }
+
+  static const size_t cache_line_size = 64;
+  std::string layout;
+  size_t stride;
+  std::vector<int> datas;
+};
+
+// Memory over a baseline taken before the first repetition of a teardown test, after
+// each repetition. RSS includes what the allocator keeps cached and allocated bytes do
+// not, so a leak shows as allocated bytes growing with every repetition.
+struct reclaim_stat_t {
+  explicit reclaim_stat_t(int repeat_n) {
+    allocated_deltas.reserve(repeat_n);
+    rss_base = Utils::rss_kb();
+    allocated_base = Utils::allocated_bytes();
+  }
+
+  void round(int task_n, ns destroy) {
+    auto rss = Utils::rss_kb() - rss_base;
+    auto allocated = int64_t(Utils::allocated_bytes()) - int64_t(allocated_base);
+    fmt::print("round {}: destroy {} tasks, cost {} us, {} ns per task, rss {:+} KB, "
+               "allocated {:+} bytes over baseline\n",
+               allocated_deltas.size(), task_n,
+               std::chrono::duration_cast<us>(destroy).count(),
+               destroy.count() / std::max(task_n, 1), rss, allocated);
+    allocated_deltas.push_back(allocated);
+  }
+
+  // the first repetition may fill caches, a leak grows in every later one
+  void print() const {
+    auto n = allocated_deltas.size();
+    if (n < 3) {
+      return;
+    }
+    bool growing = true;
+    for (size_t i = 2; i < n; ++i) {
+      growing &= allocated_deltas[i] > allocated_deltas[i - 1];
+    }
+    auto growth = (allocated_deltas[n - 1] - allocated_deltas[1]) / int64_t(n - 2);
+    fmt::print("allocated bytes grow {} bytes per repetition, {}\n", growth,
+               growing ? "leaking" : "reclaimed");
+  }
+
+  long rss_base;
+  size_t allocated_base;
+  std::vector<int64_t> allocated_deltas;
+};
+
+// One point of the oversubscription sweep: task_n spin tasks on worker_n workers.
+struct oversubscribe_run_t {
+  oversubscribe_run_t(int task_n, uint64_t work_n)
+      : tasks(task_n, spin_task_t{work_n, {}, {}}) {}
+
+  void start() {
+    switches_before = Utils::involuntary_switches();
+    run_before = clk::now();
+  }
+
+  spin_task_t *submit(int i) {
+    tasks[i].born = clk::now();
+    return &tasks[i];
+  }
+
+  void stop() {
+    run_after = clk::now();
+    switches_after = Utils::involuntary_switches();
+  }
+
+  // prints throughput, involuntary switches and task latency, returns tasks/s
+  double print(int worker_n) {
+    auto run_us = std::chrono::duration_cast<us>(run_after - run_before).count();
+    auto rate = tasks.size() * 1e6 / std::max<long>(run_us, 1);
+    fmt::print("{} workers on {} cpus: {} tasks, cost {} us, {:.0f} tasks/s, {} involuntary "
+               "switches\n",
+               worker_n, Utils::cpu_count(), tasks.size(), run_us, rate,
+               switches_after - switches_before);
+    std::vector<ns> latencies;
+    latencies.reserve(tasks.size());
+    for (auto &task : tasks) {
+      latencies.push_back(task.latency);
+    }
+    Utils::print_latency("task", latencies);
+    return rate;
+  }
+
+  std::vector<spin_task_t> tasks;
+  time_point_t run_before, run_after;
+  long switches_before = 0;
+  long switches_after = 0;
+};
+
+// Runs run(worker_n, point) for every worker count of Utils::oversubscribed_workers(),
+// then prints each throughput relative to the point with as many workers as CPUs, or to
+// the first point measured if that one wasn't. run returns false to skip a worker count
+// the library can't run with.
+template <typename Run> void oversubscribe_sweep(int task_n, uint64_t work_n, Run run) {
+  std::vector<std::pair<int, double>> rates;
+  std::pair<int, double> base{0, 0};
+  for (auto worker_n : Utils::oversubscribed_workers()) {
+    oversubscribe_run_t point(task_n, work_n);
+    if (!run(worker_n, point)) {
+      continue;
+    }
+    auto rate = point.print(worker_n);
+    rates.emplace_back(worker_n, rate);
+    if (worker_n == Utils::cpu_count() || base.first == 0) {
+      base = rates.back();
+    }
+  }
+  for (auto &rate : rates) {
+    fmt::print("{} workers: {:.2f}x the throughput of {} workers\n", rate.first,
+               rate.second / base.second, base.first);
+  }
+}
+
+// profiling, defined in benchmark.cpp
+DECLARE_bool(profile_cpu);
+DECLARE_bool(profile_heap);
+DECLARE_string(profile_dir);
+DECLARE_int32(profile_top);
+
+// Wrap a measured region in gperftools' CPU and/or heap profiler, writing one
+// profile per test and parameter point, e.g. prof/pthread_create_join_test.1000.prof.
+// Profiles are listed by summary() with the top symbols of each.
+struct Profile {
+  template <typename... Args> explicit Profile(const char *test, const Args &...point) {
+    if (!FLAGS_profile_cpu && !FLAGS_profile_heap) {
+      return;
+    }
+    name = FLAGS_profile_dir + "/" + test;
+    int expand[] = {0, (name += "." + fmt::format("{}", point), 0)...};
+    (void)expand;
+    mkdir(FLAGS_profile_dir.c_str(), 0755);
+
+    if (FLAGS_profile_cpu && ProfilerStart((name + ".prof").c_str())) {
+      cpu_running = true;
+      profiles().push_back(name + ".prof");
+    }
+    auto &heap = heap_profiler();
+    if (FLAGS_profile_heap && !heap.start) {
+      static bool warned = false;
+      if (!warned) {
+        fmt::print("heap profiling needs tcmalloc, linked or preloaded, skipped\n");
+        warned = true;
+      }
+    } else if (FLAGS_profile_heap && !heap.running()) {
+      heap.start(name.c_str());
+      heap_running = true;
+    }
+  }
+
+  ~Profile() { stop(); }
+
+  // end the region early, before the test prints and cleans up
+  void stop() {
+    if (cpu_running) {
+      ProfilerStop();
+      cpu_running = false;
+    }
+    if (heap_running) {
+      heap_profiler().dump("end of region");
+      heap_profiler().stop();
+      profiles().push_back(name + ".0001.heap");
+      heap_running = false;
+    }
+  }
+
+  // print the top symbols of every profile written so far
+  static void summary() {
+    char exe[4096] = {};
+    if (profiles().empty() || readlink("/proc/self/exe", exe, sizeof(exe) - 1) < 0) {
+      return;
+    }
+    for (auto &profile : profiles()) {
+      auto cmd = fmt::format("pprof --text --nodecount={} {} {}", FLAGS_profile_top, exe,
+                             profile);
+      fmt::print("==> {}\n", profile);
+      auto pipe = popen((cmd + " 2>/dev/null").c_str(), "r");
+      char line[1024];
+      bool printed = false;
+      while (pipe && fgets(line, sizeof(line), pipe)) {
+        fmt::print("{}", line);
+        printed = true;
+      }
+      if (pipe) {
+        pclose(pipe);
+      }
+      if (!printed) {
+        fmt::print("pprof not found, run `{}` for top symbols\n", cmd);
+      }
+    }
+  }
+
+  static std::vector<std::string> &profiles() {
+    static std::vector<std::string> profiles;
+    return profiles;
+  }
+
+  // The heap profiler is part of tcmalloc, which may only be preloaded or not there at
+  // all (see alloc_test), so look it up rather than link against it.
+  struct heap_profiler_t {
+    int (*running)();
+    void (*start)(const char *);
+    void (*dump)(const char *);
+    void (*stop)();
+  };
+
+  static const heap_profiler_t &heap_profiler() {
+    static const heap_profiler_t profiler{
+        reinterpret_cast<int (*)()>(dlsym(RTLD_DEFAULT, "IsHeapProfilerRunning")),
+        reinterpret_cast<void (*)(const char *)>(dlsym(RTLD_DEFAULT, "HeapProfilerStart")),
+        reinterpret_cast<void (*)(const char *)>(dlsym(RTLD_DEFAULT, "HeapProfilerDump")),
+        reinterpret_cast<void (*)()>(dlsym(RTLD_DEFAULT, "HeapProfilerStop"))};
+    return profiler;
+  }
+
+  std::string name;
+  bool cpu_running = false;
+  bool heap_running = false;
+};
+
+// Runs run(args) with the counters of task_n tasks 4 to 256 bytes apart, then prints the
+// write rate at each distance against counters 128 bytes apart, which keeps them out of
+// each other's line and out of the line pair the adjacent-line prefetcher pulls in.
+template <typename Run>
+void false_sharing_sweep(const char *test, int task_n, uint64_t write_n, Run run) {
+  const size_t distances[] = {4, 8, 16, 32, 64, 128, 256};
+  const size_t base_distance = 128;
+  void *counters = nullptr;
+  if (posix_memalign(&counters, 4096, task_n * distances[6]) != 0) {
+    return;
+  }
+  std::vector<std::pair<size_t, double>> rates;
+  double base_rate = 0;
+  for (auto distance : distances) {
+    memset(counters, 0, task_n * distances[6]);
+    std::vector<sharing_args_t> args(task_n);
+    for (int i = 0; i < task_n; ++i) {
+      args[i] = {reinterpret_cast<uint32_t *>(static_cast<char *>(counters) + i * distance),
+                 write_n};
+    }
+    Profile profile(test, task_n, distance);
+    auto run_before = clk::now();
+    run(args);
+    auto run_after = clk::now();
+    profile.stop();
+    for (auto &arg : args) {
+      if (*arg.counter != uint32_t(write_n)) {
+        fmt::print("a counter {} bytes apart lost writes\n", distance);
+      }
+    }
+    auto run_ns = std::chrono::duration_cast<ns>(run_after - run_before).count();
+    auto rate = double(task_n) * write_n * 1e3 / std::max<int64_t>(run_ns, 1);
+    rates.emplace_back(distance, rate);
+    if (distance == base_distance) {
+      base_rate = rate;
+    }
+  }
+  free(counters);
+  for (auto &rate : rates) {
+    fmt::print("{} tasks, counters {} bytes apart: {:.1f} M writes/s, {:.2f}x the cost of "
+               "counters {} bytes apart\n",
+               task_n, rate.first, rate.second, base_rate / rate.second, base_distance);
+  }
+}
+
 struct Benchmark {
   void (*create_join_test)(int thread_n);
   void (*loop_test_1)(int thread_n);
@@ -41,5 +863,18 @@ struct Benchmark {
   void (*ctx_switch_test_1)(uint64_t switch_n);
   void (*ctx_switch_test_2)(int thread_n, uint64_t switch_n);
   void (*lib_specific_test)(int thread_n);
+  void (*pipeline_test)(int stage_n, int item_n, int batch_n);
+  void (*stack_fault_test)(int thread_n, bool prefault);
+  void (*tls_test)(int thread_n, int migrate_n, uint64_t access_n);
+  void (*queue_test)(int producer_n, int consumer_n, uint64_t item_n, int batch_n);
+  void (*hybrid_test)(int thread_n, uint64_t switch_n);
+  void (*lifecycle_test)(int worker_n);
+  void (*teardown_test)(int thread_n, int repeat_n);
+  void (*oversubscribe_test)(int task_n, uint64_t work_n);
+  void (*join_test)(int max_n);
+  void (*false_sharing_test)(int thread_n, uint64_t write_n);
+  void (*alloc_test)(int thread_n, uint64_t alloc_n);
+  void (*scatter_gather_test)(int request_n, int fanout_k, uint64_t deadline_us);
+  void (*inline_test)(int task_n, uint64_t switch_n);
 };
 // global definitions end
@@ -0,0 +1,118 @@
+#pragma once
+#include "benchmark.h"
+#include "queue.h"
+#include "trace.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+// A fixed pool of pthreads running void *(*)(void *) tasks, the in-repo executor the
+// library schedulers are compared with. Tasks go through a Vyukov MPMC queue (see
+// queue_test), idle workers sleep on a condition variable.
+struct thread_pool_t {
+  struct task_t {
+    void *(*fn)(void *);
+    void *arg;
+  };
+
+  thread_pool_t() : tasks(4096) {}
+  explicit thread_pool_t(int worker_n) : thread_pool_t() { start(worker_n); }
+
+  // start the workers, return the time until a first task has run on one of them
+  ns start(int worker_n) {
+    std::atomic<bool> started{false};
+    auto start_before = clk::now();
+    workers.resize(worker_n);
+    for (auto &tid : workers) {
+      pthread_create(&tid, nullptr, f_worker, this);
+    }
+    post(f_started, &started);
+    while (!started.load(std::memory_order_acquire)) {
+      sched_yield();
+    }
+    return std::chrono::duration_cast<ns>(clk::now() - start_before);
+  }
+
+  ~thread_pool_t() { stop(); }
+
+  void post(void *(*fn)(void *), void *arg) {
+    TRACE("thread_pool_task", spawn, arg);
+    while (!tasks.push(task_t{fn, arg})) {
+      sched_yield();
+    }
+    // The push ends with a release store to another location; without a StoreLoad fence
+    // idle_n could be read before it is visible, miss a worker that re-checked an empty
+    // queue after ++idle_n, and strand the task. Pairs with the seq_cst ++idle_n.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_n.load() > 0) {
+      std::lock_guard<std::mutex> guard(mutex);
+      ready.notify_one();
+    }
+  }
+
+  // wait for the workers to finish queued tasks and exit, return the time it took
+  ns stop() {
+    auto stop_before = clk::now();
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (stopped) {
+        return ns{0};
+      }
+      stopped = true;
+      ready.notify_all();
+    }
+    for (auto tid : workers) {
+      pthread_join(tid, nullptr);
+    }
+    return std::chrono::duration_cast<ns>(clk::now() - stop_before);
+  }
+
+  static void *f_started(void *started) {
+    static_cast<std::atomic<bool> *>(started)->store(true, std::memory_order_release);
+    return nullptr;
+  }
+
+  static void *f_worker(void *pool) {
+    auto self = static_cast<thread_pool_t *>(pool);
+    task_t task;
+    for (;;) {
+      if (self->tasks.pop(task)) {
+        run(task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(self->mutex);
+      // re-check after announcing ourselves idle, post() may have missed us
+      ++self->idle_n;
+      if (self->tasks.pop(task)) {
+        --self->idle_n;
+        lock.unlock();
+        run(task);
+        continue;
+      }
+      if (self->stopped) {
+        --self->idle_n;
+        return nullptr;
+      }
+      TRACE("thread_pool_worker", block, 0);
+      self->ready.wait(lock);
+      TRACE("thread_pool_worker", wake, 0);
+      --self->idle_n;
+    }
+  }
+
+  static void run(const task_t &task) {
+    TRACE("thread_pool_task", start, task.arg);
+    task.fn(task.arg);
+    TRACE("thread_pool_task", finish, task.arg);
+  }
+
+  mpmc_queue_t<task_t> tasks;
+  std::vector<pthread_t> workers;
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::atomic<int> idle_n{0};
+  bool stopped = false;
+};
@@ -0,0 +1,164 @@
+#pragma once
+// C++20 only: include from targets built with CXX_STANDARD 20.
+#include "benchmark.h"
+#include "trace.h"
+#include <atomic>
+#include <coroutine>
+#include <latch>
+
+// Stackless coroutines resumed by the worker pool of another scheduler.
+// An Executor has post(std::coroutine_handle<>), making one of its workers resume the
+// handle, and `co_await schedule_on(executor)` moves the coroutine onto that pool.
+
+// Unlike the cpp20co coroutine, a hybrid coroutine frees its frame when it finishes,
+// since it finishes on a worker that nobody joins.
+struct hybrid_promise;
+struct hybrid_coroutine : std::coroutine_handle<hybrid_promise> {
+  using promise_type = struct hybrid_promise;
+};
+
+struct hybrid_promise {
+  // traced, so that the first and last slices of a coroutine, around its schedule_on
+  // hops, are closed on the track of the thread they ran on
+  struct initial_t : std::suspend_always {
+    void await_resume() { TRACE("hybrid_coroutine", start, frame); }
+    void *frame;
+  };
+
+  hybrid_coroutine get_return_object() { return {hybrid_coroutine::from_promise(*this)}; }
+  initial_t initial_suspend() noexcept {
+    return {{}, hybrid_coroutine::from_promise(*this).address()};
+  }
+  std::suspend_never final_suspend() noexcept {
+    TRACE("hybrid_coroutine", finish, hybrid_coroutine::from_promise(*this).address());
+    return {};
+  }
+  void return_void() {}
+  void unhandled_exception() {}
+
+  static void *operator new(size_t size) {
+    frame_size.store(size, std::memory_order_relaxed);
+    return ::operator new(size);
+  }
+  static void operator delete(void *frame) { ::operator delete(frame); }
+
+  static inline std::atomic<size_t> frame_size{0};
+};
+
+template <typename Executor> struct schedule_t {
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    suspended = handle;
+    TRACE("schedule_on", yield, handle.address());
+    executor.post(handle);
+  }
+  void await_resume() { TRACE("schedule_on", resume, suspended.address()); }
+  Executor &executor;
+  std::coroutine_handle<> suspended{};
+};
+
+template <typename Executor> schedule_t<Executor> schedule_on(Executor &executor) {
+  return {executor};
+}
+
+// a void *(*)(void *) task resuming a coroutine handle, for executors of that shape
+inline void *f_resume(void *handle) {
+  std::coroutine_handle<>::from_address(handle).resume();
+  return nullptr;
+}
+
+// The create/join, loop and ctx switch tests with hybrid coroutines on executor, plus
+// the memory held by coroutine_n suspended coroutines.
+template <typename Executor>
+void hybrid_tests(Executor &executor, const char *pool, int coroutine_n, uint64_t switch_n) {
+  // create and join
+  {
+    std::latch done(coroutine_n);
+    std::vector<hybrid_coroutine> coroutines(coroutine_n);
+    Profile profile("hybrid_create_join_test", pool, coroutine_n);
+    auto create_before = clk::now();
+    for (auto &tid : coroutines) {
+      tid = [](Executor &executor, std::latch &done) -> hybrid_coroutine {
+        co_await schedule_on(executor);
+        Utils::f_null(nullptr);
+        done.count_down();
+      }(executor, done);
+    }
+    auto create_after = clk::now();
+    auto create_us = std::chrono::duration_cast<us>(create_after - create_before).count();
+
+    TRACE(__func__, block, 0);
+    auto join_before = clk::now();
+    for (auto &tid : coroutines) {
+      tid.resume();
+    }
+    done.wait();
+    auto join_after = clk::now();
+    TRACE(__func__, wake, 0);
+    profile.stop();
+    auto join_us = std::chrono::duration_cast<us>(join_after - join_before).count();
+    fmt::print("create {} coroutines, cost {} us\n", coroutine_n, create_us);
+    fmt::print("schedule and join {} coroutines on {}, cost {} us\n", coroutine_n, pool,
+               join_us);
+  }
+
+  // loop test 1
+  {
+    std::vector<int> datas(coroutine_n, 10);
+    std::latch done(coroutine_n);
+    Profile profile("hybrid_loop_test_1", pool, coroutine_n);
+    auto run_before = clk::now();
+    for (int i = 0; i < coroutine_n; ++i) {
+      auto tid = [](Executor &executor, int *data, std::latch &done) -> hybrid_coroutine {
+        co_await schedule_on(executor);
+        Utils::f_mul_1(data);
+        done.count_down();
+      }(executor, &datas[i], done);
+      tid.resume();
+    }
+    done.wait();
+    auto run_after = clk::now();
+    profile.stop();
+    auto run_us = std::chrono::duration_cast<us>(run_after - run_before).count();
+    fmt::print("launch {} coroutines on {} to multiply a vector to a scalar, end-to-end "
+               "cost {} us\n",
+               coroutine_n, pool, run_us);
+  }
+
+  // ctx switch test 1: every switch is a round trip through the pool's queue
+  {
+    std::latch done(1);
+    Profile profile("hybrid_ctx_switch_test_1", pool, switch_n);
+    auto switch_before = clk::now();
+    auto tid = [](Executor &executor, uint64_t switch_n, std::latch &done) -> hybrid_coroutine {
+      while (switch_n--) {
+        co_await schedule_on(executor);
+      }
+      done.count_down();
+    }(executor, switch_n, done);
+    tid.resume();
+    done.wait();
+    auto switch_after = clk::now();
+    profile.stop();
+    auto switch_us = std::chrono::duration_cast<us>(switch_after - switch_before).count();
+    fmt::print("launch 1 coroutines on {}, switch in-and-out {} times, cost {} us.\n", pool,
+               switch_n, switch_us);
+  }
+
+  // memory of suspended coroutines
+  {
+    auto rss_before = Utils::rss_kb();
+    std::vector<hybrid_coroutine> coroutines(coroutine_n);
+    for (auto &tid : coroutines) {
+      tid = [](Executor &executor) -> hybrid_coroutine {
+        co_await schedule_on(executor);
+      }(executor);
+    }
+    auto rss_after = Utils::rss_kb();
+    fmt::print("{} suspended coroutines hold {} KB, {} bytes per frame\n", coroutine_n,
+               rss_after - rss_before, hybrid_promise::frame_size.load());
+    for (auto &tid : coroutines) {
+      tid.destroy();
+    }
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "benchmark.h"
+#include <algorithm>
+#include <vector>
+
+// Compile-time test harness. The backend, the task body and the operation are template
+// parameters, so the compiler sees the whole measured loop and can inline it; the
+// Benchmark table of function pointers stays the front end. inline_compare runs an
+// operation with a body the compiler sees through, then with the same body behind a
+// void *(*)(void *) and the run behind a function pointer, like the other tests. The
+// difference is what indirection costs on top of the scheduler's own work.
+//
+// A Backend has
+//   handle_t, name(),
+//   template <typename Body> static handle_t spawn(Body, int *): a task running Body,
+//   static void join(handle_t &),
+//   template <typename Body> static ns switch_loop(Body, int *, uint64_t switch_n): one
+//       task switching in-and-out switch_n times and running Body each time, timed.
+
+// bodies: the inlinable twins of Utils::f_null and Utils::f_mul_1
+struct body_null_t {
+  static const char *name() { return "f_null"; }
+  static const char *indirect_name() { return "f_null_indirect"; }
+  void operator()(int *) const {}
+};
+
+struct body_mul_1_t {
+  static const char *name() { return "f_mul_1"; }
+  static const char *indirect_name() { return "f_mul_1_indirect"; }
+  void operator()(int *value) const { *value = Utils::op_mul_1(*value); }
+};
+
+// a Body as a void *(*)(void *) task, for backends taking those
+template <typename Body> void *f_body(void *value) {
+  Body()(static_cast<int *>(value));
+  return nullptr;
+}
+
+// a Body behind a function pointer the compiler can't see through; named apart from Body
+// so the two variants get their own profiles
+template <typename Body> struct body_indirect_t {
+  static const char *name() { return Body::indirect_name(); }
+  void operator()(int *value) const {
+    void *(*volatile task)(void *) = f_body<Body>;
+    task(value);
+  }
+};
+
+// ops: what is measured, n times
+struct op_spawn_join_t {
+  static const char *name() { return "spawn_join"; }
+  template <typename Backend, typename Body> static ns run(uint64_t task_n) {
+    std::vector<int> datas(task_n, 10);
+    std::vector<typename Backend::handle_t> handles(task_n);
+    auto run_before = clk::now();
+    for (uint64_t i = 0; i < task_n; ++i) {
+      handles[i] = Backend::spawn(Body(), &datas[i]);
+    }
+    for (auto &handle : handles) {
+      Backend::join(handle);
+    }
+    return std::chrono::duration_cast<ns>(clk::now() - run_before);
+  }
+};
+
+struct op_switch_t {
+  static const char *name() { return "switch"; }
+  template <typename Backend, typename Body> static ns run(uint64_t switch_n) {
+    int data = 10;
+    return Backend::switch_loop(Body(), &data, switch_n);
+  }
+};
+
+template <typename Backend, typename Body, typename Op> ns inline_run(uint64_t n) {
+  Profile profile("inline_run", Backend::name(), Op::name(), Body::name(), n);
+  return Op::template run<Backend, Body>(n);
+}
+
+// best of 3 rounds each, the two variants interleaved
+template <typename Backend, typename Body, typename Op> void inline_compare(uint64_t n) {
+  ns (*volatile indirect_run)(uint64_t) = inline_run<Backend, body_indirect_t<Body>, Op>;
+  auto inlined = ns::max(), indirect = ns::max();
+  for (int round = 0; round < 3; ++round) {
+    inlined = std::min(inlined, inline_run<Backend, Body, Op>(n));
+    indirect = std::min(indirect, indirect_run(n));
+  }
+  auto per_op = [n](ns duration) {
+    return double(duration.count()) / std::max<uint64_t>(n, 1);
+  };
+  fmt::print("{} {} x {} with {}: inlined {:.1f} ns, indirect {:.1f} ns, indirection "
+             "{:+.1f} ns per op\n",
+             Backend::name(), Op::name(), n, Body::name(), per_op(inlined),
+             per_op(indirect), per_op(indirect) - per_op(inlined));
+}
+
+template <typename Backend> void inline_tests(int task_n, uint64_t switch_n) {
+  inline_compare<Backend, body_null_t, op_spawn_join_t>(task_n);
+  inline_compare<Backend, body_mul_1_t, op_spawn_join_t>(task_n);
+  inline_compare<Backend, body_null_t, op_switch_t>(switch_n);
+  inline_compare<Backend, body_mul_1_t, op_switch_t>(switch_n);
+}
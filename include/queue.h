@@ -0,0 +1,330 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Bounded task queues sharing one interface:
+//   bool push(const T &item);                  // false when full
+//   bool pop(T &item);                         // false when empty
+//   size_t push_n(const T *items, size_t n);   // push up to n, return how many
+//   size_t pop_n(T *items, size_t n);          // pop up to n, return how many
+//   static const int max_producer, max_consumer;
+//   static const bool batch_pop;               // pop_n takes its items at once
+// Indices written by different sides are kept on different cache lines.
+
+static const size_t cache_line = 64;
+
+static inline size_t round_up_pow2(size_t n) {
+  size_t capacity = 1;
+  while (capacity < n) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+// Dmitry Vyukov's bounded MPMC queue: every cell carries a sequence number telling
+// producers and consumers whose turn it is, one CAS per push or pop. A batch takes the
+// run of ready cells from its position, up to n, with one CAS.
+template <typename T> struct mpmc_queue_t {
+  static const int max_producer = INT_MAX;
+  static const int max_consumer = INT_MAX;
+  static const bool batch_pop = true;
+  static const char *name() { return "vyukov mpmc"; }
+
+  explicit mpmc_queue_t(size_t capacity)
+      : mask(round_up_pow2(capacity) - 1), cells(new cell_t[mask + 1]) {
+    for (size_t i = 0; i <= mask; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(const T &item) {
+    cell_t *cell;
+    auto pos = enqueue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells[pos & mask];
+      auto dif = intptr_t(cell->sequence.load(std::memory_order_acquire)) - intptr_t(pos);
+      if (dif == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->item = item;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T &item) {
+    cell_t *cell;
+    auto pos = dequeue_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells[pos & mask];
+      auto dif =
+          intptr_t(cell->sequence.load(std::memory_order_acquire)) - intptr_t(pos + 1);
+      if (dif == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+    item = cell->item;
+    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t push_n(const T *items, size_t n) {
+    size_t pos;
+    n = claim(enqueue_pos, 0, std::min(n, mask + 1), pos);
+    for (size_t i = 0; i < n; ++i) {
+      auto &cell = cells[(pos + i) & mask];
+      cell.item = items[i];
+      cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
+  size_t pop_n(T *items, size_t n) {
+    size_t pos;
+    n = claim(dequeue_pos, 1, std::min(n, mask + 1), pos);
+    for (size_t i = 0; i < n; ++i) {
+      auto &cell = cells[(pos + i) & mask];
+      items[i] = cell.item;
+      cell.sequence.store(pos + i + mask + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
+  // Move side_pos past the cells ready for this side, whose sequence is their position
+  // plus turn (0 for a producer, 1 for a consumer), at most n of them. Return how many,
+  // the first in pos. Once the CAS succeeds nobody else can touch them: side_pos only
+  // grows, and the other side waits for the sequences this side stores.
+  size_t claim(std::atomic<size_t> &side_pos, size_t turn, size_t n, size_t &pos) {
+    if (n == 0) {
+      return 0;
+    }
+    pos = side_pos.load(std::memory_order_relaxed);
+    for (;;) {
+      size_t ready_n = 0;
+      while (ready_n < n && cells[(pos + ready_n) & mask].sequence.load(
+                                std::memory_order_acquire) == pos + ready_n + turn) {
+        ++ready_n;
+      }
+      if (ready_n > 0) {
+        // a failed CAS reloads pos
+        if (side_pos.compare_exchange_weak(pos, pos + ready_n, std::memory_order_relaxed)) {
+          return ready_n;
+        }
+        continue;
+      }
+      auto dif = intptr_t(cells[pos & mask].sequence.load(std::memory_order_acquire)) -
+                 intptr_t(pos + turn);
+      if (dif < 0) {
+        return 0; // full, or empty
+      }
+      pos = side_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  struct cell_t {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  const size_t mask;
+  std::unique_ptr<cell_t[]> cells;
+  char padding_0[cache_line];
+  std::atomic<size_t> enqueue_pos{0};
+  char padding_1[cache_line];
+  std::atomic<size_t> dequeue_pos{0};
+  char padding_2[cache_line];
+};
+
+// Chase-Lev work-stealing deque with a fixed buffer (Le et al., PPoPP'13). The owner
+// pushes and pops at the bottom, thieves steal at the top. In the shared interface
+// push() is the owner's push and pop() is a steal; pop_local() is the owner's pop.
+template <typename T> struct ws_deque_t {
+  static const int max_producer = 1;
+  static const int max_consumer = INT_MAX;
+  static const bool batch_pop = false;
+  static const char *name() { return "chase-lev deque"; }
+
+  explicit ws_deque_t(size_t capacity)
+      : mask(round_up_pow2(capacity) - 1), items(new std::atomic<T>[mask + 1]) {}
+
+  bool push(const T &item) {
+    auto b = bottom.load(std::memory_order_relaxed);
+    auto t = top.load(std::memory_order_acquire);
+    if (b - t > int64_t(mask)) {
+      return false;
+    }
+    items[b & mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool pop_local(T &item) {
+    auto b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    item = items[b & mask].load(std::memory_order_relaxed);
+    if (t == b) {
+      // last item, race against thieves
+      bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                             std::memory_order_relaxed);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  bool pop(T &item) {
+    auto t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    auto b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return false;
+    }
+    item = items[t & mask].load(std::memory_order_relaxed);
+    return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed);
+  }
+
+  // the owner publishes the whole batch with one store to bottom
+  size_t push_n(const T *batch, size_t n) {
+    auto b = bottom.load(std::memory_order_relaxed);
+    auto t = top.load(std::memory_order_acquire);
+    n = std::min(n, mask + 1 - size_t(b - t));
+    for (size_t i = 0; i < n; ++i) {
+      items[(b + i) & mask].store(batch[i], std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + int64_t(n), std::memory_order_relaxed);
+    return n;
+  }
+
+  // One steal at a time: a thief moving top past several items with one CAS could take
+  // items the owner popped from the bottom after the thief read it, since the owner only
+  // races thieves on the last item. A failed steal may be a lost race rather than an
+  // empty deque, stop at either.
+  size_t pop_n(T *batch, size_t n) {
+    size_t i = 0;
+    while (i < n && pop(batch[i])) {
+      ++i;
+    }
+    return i;
+  }
+
+  const size_t mask;
+  std::unique_ptr<std::atomic<T>[]> items;
+  char padding_0[cache_line];
+  std::atomic<int64_t> top{0};
+  char padding_1[cache_line];
+  std::atomic<int64_t> bottom{0};
+  char padding_2[cache_line];
+};
+
+// Single-producer single-consumer ring. Each side caches the other side's index and
+// only re-reads it when the ring looks full or empty; a batch is published with one
+// store.
+template <typename T> struct spsc_ring_t {
+  static const int max_producer = 1;
+  static const int max_consumer = 1;
+  static const bool batch_pop = true;
+  static const char *name() { return "spsc ring"; }
+
+  explicit spsc_ring_t(size_t capacity)
+      : mask(round_up_pow2(capacity) - 1), items(new T[mask + 1]) {}
+
+  bool push(const T &item) { return push_n(&item, 1) == 1; }
+  bool pop(T &item) { return pop_n(&item, 1) == 1; }
+
+  size_t push_n(const T *batch, size_t n) {
+    auto tail_now = tail.load(std::memory_order_relaxed);
+    if (tail_now - head_cached + n > mask + 1) {
+      head_cached = head.load(std::memory_order_acquire);
+    }
+    n = std::min(n, mask + 1 - (tail_now - head_cached));
+    for (size_t i = 0; i < n; ++i) {
+      items[(tail_now + i) & mask] = batch[i];
+    }
+    tail.store(tail_now + n, std::memory_order_release);
+    return n;
+  }
+
+  size_t pop_n(T *batch, size_t n) {
+    auto head_now = head.load(std::memory_order_relaxed);
+    if (tail_cached - head_now < n) {
+      tail_cached = tail.load(std::memory_order_acquire);
+    }
+    n = std::min(n, tail_cached - head_now);
+    for (size_t i = 0; i < n; ++i) {
+      batch[i] = items[(head_now + i) & mask];
+    }
+    head.store(head_now + n, std::memory_order_release);
+    return n;
+  }
+
+  const size_t mask;
+  std::unique_ptr<T[]> items;
+  char padding_0[cache_line];
+  // consumer side
+  std::atomic<size_t> head{0};
+  size_t tail_cached = 0;
+  char padding_1[cache_line];
+  // producer side
+  std::atomic<size_t> tail{0};
+  size_t head_cached = 0;
+  char padding_2[cache_line];
+};
+
+// std::deque behind a mutex, the reference the lock-free queues are measured against.
+template <typename T> struct mutex_queue_t {
+  static const int max_producer = INT_MAX;
+  static const int max_consumer = INT_MAX;
+  static const bool batch_pop = true;
+  static const char *name() { return "mutex deque"; }
+
+  explicit mutex_queue_t(size_t capacity) : capacity(capacity) {}
+
+  bool push(const T &item) { return push_n(&item, 1) == 1; }
+  bool pop(T &item) { return pop_n(&item, 1) == 1; }
+
+  size_t push_n(const T *batch, size_t n) {
+    std::lock_guard<std::mutex> guard(mutex);
+    n = std::min(n, capacity - items.size());
+    items.insert(items.end(), batch, batch + n);
+    return n;
+  }
+
+  size_t pop_n(T *batch, size_t n) {
+    std::lock_guard<std::mutex> guard(mutex);
+    n = std::min(n, items.size());
+    std::copy(items.begin(), items.begin() + n, batch);
+    items.erase(items.begin(), items.begin() + n);
+    return n;
+  }
+
+  const size_t capacity;
+  std::mutex mutex;
+  std::deque<T> items;
+};
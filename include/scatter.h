@@ -0,0 +1,77 @@
+#pragma once
+#include "benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <vector>
+
+// Scatter-gather tests. A request fans out to fanout_k sub-tasks, waits for all of them
+// or for its deadline, whichever comes first, and cancels the sub-tasks still in flight.
+// Sub-task latencies are exponential with a mean of a quarter of the deadline: a sub-task
+// misses the deadline about 2% of the time, a request of K of them about 1 - 0.98^K.
+struct scatter_request_t {
+  scatter_request_t(int fanout_k, us deadline, std::mt19937_64 &random)
+      : latencies(fanout_k), deadline(deadline) {
+    std::exponential_distribution<double> latency(4.0 / deadline.count());
+    for (auto &sub_latency : latencies) {
+      sub_latency = us(uint64_t(std::min(latency(random), 10.0 * deadline.count())));
+    }
+  }
+
+  int fanout_k() const { return latencies.size(); }
+
+  std::vector<us> latencies;
+  us deadline;
+  std::atomic<int> finished_n{0};  // sub-tasks done, in time or cancelled
+  std::atomic<int> cancelled_n{0}; // sub-tasks stopped by the cancel
+};
+
+// a void *(*)(void *) sub-task: the index-th of a request
+struct args_scatter_t {
+  scatter_request_t *request;
+  int index;
+};
+
+// A request lasts until all of its sub-tasks are gathered or the deadline fires. The
+// cancel lasts from the deadline until the last straggler has stopped.
+struct scatter_stat_t {
+  explicit scatter_stat_t(int fanout_k) : fanout_k(fanout_k) {}
+
+  void round(ns request, bool missed, ns cancel, int straggler_n) {
+    requests.push_back(request);
+    if (missed) {
+      ++miss_n;
+      cancels.push_back(cancel);
+      stragglers_n += straggler_n;
+      cancel_total += cancel;
+    }
+  }
+
+  void print(us deadline) {
+    fmt::print("fanout {}: {} requests, {:.1f}% missed the {} us deadline, {} stragglers "
+               "cancelled, {} ns per cancelled sub-task\n",
+               fanout_k, requests.size(),
+               miss_n * 100.0 / std::max<size_t>(requests.size(), 1), deadline.count(),
+               stragglers_n,
+               cancel_total.count() / std::max<uint64_t>(stragglers_n, 1));
+    Utils::print_latency("request", requests);
+    Utils::print_latency("cancel", cancels);
+  }
+
+  // fan-outs of the sweep: 1, 2, 4, ... up to max_k
+  static std::vector<int> fanouts(int max_k) {
+    std::vector<int> fanouts;
+    for (int fanout_k = 1; fanout_k < max_k; fanout_k *= 2) {
+      fanouts.push_back(fanout_k);
+    }
+    fanouts.push_back(max_k);
+    return fanouts;
+  }
+
+  int fanout_k;
+  std::vector<ns> requests;
+  std::vector<ns> cancels;
+  int miss_n = 0;
+  uint64_t stragglers_n = 0;
+  ns cancel_total{0};
+};
@@ -0,0 +1,242 @@
+#pragma once
+#include "benchmark.h"
+#include "queue.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Opt-in task lifecycle tracing. TRACE(name, event, task) records an event of a task in
+// a ring of the calling worker; with --trace, the rings are written as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev) at exit. Every worker is one track, a task shows
+// as a slice from start/resume to yield/finish. Spawns, blocks and wakes are instant
+// events: a worker's wake has no block before it, and as a slice end it would unbalance
+// the track. So is an end whose start was overwritten or not traced.
+// A ring keeps the last --trace_buffer events of its worker, and the ring of an exiting
+// thread goes back to a free list for the next thread, so the rings are as many as the
+// threads alive at once at most: memory stays bounded in long runs and with a thread per
+// task.
+
+// tracing, defined in benchmark.cpp
+DECLARE_bool(trace);
+DECLARE_string(trace_file);
+DECLARE_int32(trace_buffer);
+
+#define TRACE(name, event, task)                                                       \
+  do {                                                                                 \
+    if (Tracer::enabled().load(std::memory_order_relaxed)) {                           \
+      Tracer::record(name, trace_event_t::event, uint64_t(task));                      \
+    }                                                                                  \
+  } while (0)
+
+enum class trace_event_t : uint8_t { spawn, start, yield, resume, block, wake, finish };
+
+struct trace_record_t {
+  uint64_t tsc;
+  uint64_t task;
+  const char *name;
+  trace_event_t event;
+  int worker;
+};
+
+// One writer, the worker owning it, which may change when the ring is recycled. Old
+// records are overwritten.
+struct trace_ring_t {
+  trace_ring_t(size_t capacity, int worker)
+      : mask(round_up_pow2(capacity) - 1), records(new trace_record_t[mask + 1]),
+        worker(worker) {}
+
+  void push(trace_record_t record) {
+    auto tail_now = tail.load(std::memory_order_relaxed);
+    record.worker = worker;
+    records[tail_now & mask] = record;
+    tail.store(tail_now + 1, std::memory_order_release);
+  }
+
+  const size_t mask;
+  std::unique_ptr<trace_record_t[]> records;
+  std::atomic<uint64_t> tail{0};
+  int worker;
+};
+
+struct Tracer {
+  static uint64_t tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<ns>(clk::now().time_since_epoch()).count();
+#endif
+  }
+
+  // read by every worker, written at start and at exit
+  static std::atomic<bool> &enabled() {
+    static std::atomic<bool> on{false};
+    return on;
+  }
+
+  static void start() {
+    state().tsc_before = tsc();
+    state().clk_before = clk::now();
+    enabled().store(true, std::memory_order_relaxed);
+  }
+
+  // Not inlined, so that a coroutine migrated by its scheduler looks up the ring of the
+  // worker it runs on now rather than one cached before a switch (see tls_test).
+  __attribute__((noinline)) static void record(const char *name, trace_event_t event,
+                                               uint64_t task) {
+    auto &ring = local_ring();
+    if (!ring) {
+      ring = add_ring();
+    }
+    ring->push(trace_record_t{tsc(), task, name, event, 0});
+  }
+
+  // write the Chrome trace and report the tracing overhead
+  static void dump() {
+    if (!enabled().load(std::memory_order_relaxed)) {
+      return;
+    }
+    enabled().store(false, std::memory_order_relaxed);
+    auto tsc_after = tsc();
+    auto run_duration = clk::now() - state().clk_before;
+    auto run_ns = std::chrono::duration_cast<ns>(run_duration).count();
+    auto ticks_per_ns = double(tsc_after - state().tsc_before) / std::max<int64_t>(run_ns, 1);
+
+    auto file = fopen(FLAGS_trace_file.c_str(), "w");
+    if (!file) {
+      fmt::print("trace: can't write {}\n", FLAGS_trace_file);
+      return;
+    }
+    uint64_t event_n = 0, overwritten_n = 0;
+    bool first = true;
+    // open slices per worker: an end whose start was overwritten, or happened in an
+    // untraced switch, is written as an instant event so that the track stays balanced
+    std::vector<int> depths;
+    fmt::print(file, "{{\"traceEvents\":[");
+    std::lock_guard<std::mutex> guard(state().mutex);
+    for (auto &ring : state().rings) {
+      auto tail = ring->tail.load(std::memory_order_acquire);
+      auto head = tail > ring->mask + 1 ? tail - ring->mask - 1 : 0;
+      event_n += tail;
+      overwritten_n += head;
+      for (auto i = head; i < tail; ++i) {
+        auto &record = ring->records[i & ring->mask];
+        auto ts = (record.tsc - state().tsc_before) / ticks_per_ns / 1000;
+        if (size_t(record.worker) >= depths.size()) {
+          depths.resize(record.worker + 1);
+        }
+        auto ph = phase(record.event);
+        auto &depth = depths[record.worker];
+        if (*ph == 'B') {
+          ++depth;
+        } else if (*ph == 'E') {
+          ph = depth > 0 ? ph : "i";
+          depth -= depth > 0;
+        }
+        fmt::print(file,
+                   "{}\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"{}\",\"ts\":{:.3f},"
+                   "\"pid\":{},\"tid\":{},\"args\":{{\"task\":{}}}{}}}",
+                   first ? "" : ",", record.name, event_name(record.event),
+                   ph, ts, getpid(), record.worker, record.task,
+                   *ph == 'i' ? ",\"s\":\"t\"" : "");
+        first = false;
+      }
+    }
+    // and slices still open, of tasks that went on elsewhere untraced, end with the run
+    for (size_t worker = 0; worker < depths.size(); ++worker) {
+      for (; depths[worker] > 0; --depths[worker]) {
+        fmt::print(file, "{}\n{{\"ph\":\"E\",\"ts\":{:.3f},\"pid\":{},\"tid\":{}}}",
+                   first ? "" : ",", run_ns / 1000.0, getpid(), worker);
+        first = false;
+      }
+    }
+    fmt::print(file, "\n]}}\n");
+    fclose(file);
+
+    auto event_ns = record_cost();
+    fmt::print("trace: {} events in {} rings written to {}, {} overwritten\n", event_n,
+               state().rings.size(), FLAGS_trace_file, overwritten_n);
+    fmt::print("trace: {:.1f} ns per event, {:.3f}% of {} us\n", event_ns,
+               event_ns * event_n * 100 / std::max<int64_t>(run_ns, 1), run_ns / 1000);
+  }
+
+  // the cost of one record into a ring already set up, rdtsc included
+  static double record_cost() {
+    const int record_n = 100000;
+    trace_ring_t ring(1024, 0);
+    auto record_before = clk::now();
+    for (int i = 0; i < record_n; ++i) {
+      ring.push(trace_record_t{tsc(), uint64_t(i), "record_cost", trace_event_t::start, 0});
+    }
+    auto record_duration = clk::now() - record_before;
+    return double(std::chrono::duration_cast<ns>(record_duration).count()) / record_n;
+  }
+
+  static const char *event_name(trace_event_t event) {
+    static const char *names[] = {"spawn", "start", "yield", "resume",
+                                  "block", "wake",  "finish"};
+    return names[int(event)];
+  }
+
+  // a task runs from start/resume to yield/finish
+  static const char *phase(trace_event_t event) {
+    switch (event) {
+    case trace_event_t::spawn:
+    case trace_event_t::block:
+    case trace_event_t::wake:
+      return "i";
+    case trace_event_t::start:
+    case trace_event_t::resume:
+      return "B";
+    default:
+      return "E";
+    }
+  }
+
+  struct state_t {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<trace_ring_t>> rings;
+    std::vector<trace_ring_t *> free_rings;
+    uint64_t tsc_before = 0;
+    time_point_t clk_before;
+  };
+
+  static state_t &state() {
+    static state_t tracer_state;
+    return tracer_state;
+  }
+
+  // hands the ring of the thread back when the thread exits
+  struct ring_owner_t {
+    ~ring_owner_t() {
+      if (ring) {
+        std::lock_guard<std::mutex> guard(state().mutex);
+        state().free_rings.push_back(ring);
+      }
+    }
+    trace_ring_t *ring = nullptr;
+  };
+
+  static trace_ring_t *&local_ring() {
+    static thread_local ring_owner_t owner;
+    return owner.ring;
+  }
+
+  // a ring of an exited thread if there is one, keeping its records, or a new ring
+  static trace_ring_t *add_ring() {
+    std::lock_guard<std::mutex> guard(state().mutex);
+    if (!state().free_rings.empty()) {
+      auto ring = state().free_rings.back();
+      state().free_rings.pop_back();
+      ring->worker = Utils::worker_id();
+      return ring;
+    }
+    state().rings.emplace_back(new trace_ring_t(FLAGS_trace_buffer, Utils::worker_id()));
+    return state().rings.back().get();
+  }
+};
@@ -1,6 +1,36 @@
 // bthread start
 // bthread end
 #include "benchmark.h"
+#include "trace.h"
 #include <iostream>
+
+DEFINE_bool(profile_cpu, false, "Run gperftools' CPU profiler over each measured region");
+DEFINE_bool(profile_heap, false, "Run gperftools' heap profiler over each measured region");
+DEFINE_string(profile_dir, "prof", "Directory of the profiles");
+DEFINE_int32(profile_top, 10, "Number of top symbols to print for each profile");
+DEFINE_int32(cpus, 0, "Restrict the process to this many of its CPUs, 0 for all");
+DEFINE_int32(cpu_quota, 0, "Emulate a CFS quota of this percent of one CPU, 0 for none");
+DEFINE_string(loop_layout, "packed",
+              "Layout of the loop test 1 outputs: packed, padded or local");
+DEFINE_int32(alloc_medium_percent, 10, "Percent of 1-64KB blocks in the allocation tests");
+DEFINE_int32(alloc_remote_percent, 25, "Percent of blocks freed by another task");
+DEFINE_bool(trace, false, "Trace task lifecycle events and write a Chrome trace at exit");
+DEFINE_string(trace_file, "trace.json", "File of the Chrome trace");
+DEFINE_int32(trace_buffer, 65536, "Number of trace events kept per worker");
+
 extern Benchmark benchmark;
-int main() { benchmark.lib_specific_test(100); }
\ No newline at end of file
+int main(int argc, char *argv[]) {
+  GFLAGS_NS::ParseCommandLineFlags(&argc, &argv, true);
+  if (FLAGS_cpus > 0 && !Utils::restrict_cpus(FLAGS_cpus)) {
+    fmt::print("failed to restrict the process to {} cpus\n", FLAGS_cpus);
+  }
+  if (FLAGS_cpu_quota > 0 && !Utils::limit_cpu_quota(FLAGS_cpu_quota)) {
+    fmt::print("failed to set a cpu quota, needs a writable cgroup v2 hierarchy\n");
+  }
+  if (FLAGS_trace) {
+    Tracer::start();
+  }
+  benchmark.lib_specific_test(100);
+  Profile::summary();
+  Tracer::dump();
+}
\ No newline at end of file
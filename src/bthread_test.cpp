@@ -1,16 +1,27 @@
+#include "alloc.h"
 #include "benchmark.h"
+#include "hybrid.h"
+#include "inline.h"
+#include "scatter.h"
+#include "trace.h"
 #include <assert.h>
 #include <bthread/bthread.h>
+#include <bthread/countdown_event.h>
+#include <bthread/execution_queue.h>
 #include <chrono>
 #include <fmt/core.h>
 #include <iostream>
+#include <random>
+#include <vector>
 
 static void bthread_create_join_test(int thread_n) {
   // Create thread_n threads
   std::vector<bthread_t> threads(thread_n);
+  Profile profile(__func__, thread_n);
   auto create_before = clk::now();
   for (auto &tid : threads) {
     bthread_start_background(&tid, nullptr, Utils::f_null, nullptr);
+    TRACE(__func__, spawn, &tid);
   }
   auto create_after = clk::now();
   auto create_duration = create_after - create_before;
@@ -19,11 +30,14 @@ static void bthread_create_join_test(int thread_n) {
   fmt::print("create {} threads, cost {} us\n", thread_n, create_us);
 
   // Join thread_n threads
+  TRACE(__func__, block, 0);
   auto join_before = clk::now();
   for (auto tid : threads) {
     bthread_join(tid, NULL);
   }
   auto join_after = clk::now();
+  TRACE(__func__, wake, 0);
+  profile.stop();
   auto join_duration = join_after - join_before;
   auto join_us = std::chrono::duration_cast<us>(join_duration).count();
   fmt::print("join {} threads, cost {} us\n", thread_n, join_us);
@@ -32,28 +46,32 @@ static void bthread_create_join_test(int thread_n) {
 static void bthread_loop_test_1(int thread_n) {
   // For each element in data vector
   // create a thread to do multiply
-  std::vector<int> datas(thread_n, 10);
-  std::vector<int> results(thread_n);
-  std::transform(datas.begin(), datas.end(), results.begin(), Utils::op_mul_1<int>);
+  loop_layout_t datas(thread_n);
+  std::vector<int> results(thread_n, 10);
+  std::transform(results.begin(), results.end(), results.begin(), Utils::op_mul_1<int>);
 
   std::vector<bthread_t> threads(thread_n);
 
+  Profile profile(__func__, thread_n);
   auto run_before = clk::now();
   for (int i = 0; i < thread_n; ++i) {
-    bthread_start_background(&threads[i], nullptr, Utils::f_mul_1, &datas[i]);
+    bthread_start_background(&threads[i], nullptr, datas.task(), datas.data(i));
   }
   for (auto tid : threads) {
     bthread_join(tid, NULL);
   }
+  datas.merge();
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
-  assert(datas == results);
+  assert(datas.values() == results);
 
   fmt::print(
-      "launch {} threads to multiply a vector to a scalar, end-to-end cost {} us\n",
-      thread_n, run_us);
+      "launch {} threads to multiply a vector to a scalar, {} layout, end-to-end cost {} "
+      "us\n",
+      thread_n, datas.layout, run_us);
 }
 
 static void bthread_loop_test_2(int thread_n) {
@@ -66,6 +84,7 @@ static void bthread_loop_test_2(int thread_n) {
 
   std::vector<bthread_t> threads(thread_n);
 
+  Profile profile(__func__, thread_n);
   auto run_before = clk::now();
   for (int i = 0; i < thread_n; ++i) {
     bthread_start_background(&threads[i], nullptr, Utils::f_mul_1M, &datas[i]);
@@ -74,6 +93,7 @@ static void bthread_loop_test_2(int thread_n) {
     bthread_join(tid, NULL);
   }
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
@@ -99,11 +119,15 @@ static void *f_ctx_switch(void *args) {
   auto switch_befores = args_ctx->switch_befores;
   auto switch_afters = args_ctx->switch_afters;
 
+  TRACE("ctx_switch", start, thread_i);
   switch_befores[thread_i] = clk::now();
   while (switch_n--) {
+    TRACE("ctx_switch", yield, thread_i);
     bthread_yield();
+    TRACE("ctx_switch", resume, thread_i);
   }
   switch_afters[thread_i] = clk::now();
+  TRACE("ctx_switch", finish, thread_i);
 
   return nullptr;
 }
@@ -117,9 +141,11 @@ static void bthread_ctx_switch_test_1(uint64_t switch_n) {
   auto arg = new args_ctx_switch_t{0, switch_n, switch_before, switch_after};
 
   // thread
+  Profile profile(__func__, switch_n);
   pthread_t tid{};
   bthread_start_background(&tid, nullptr, f_ctx_switch, arg);
   bthread_join(tid, nullptr);
+  profile.stop();
 
   auto switch_duration = *switch_after - *switch_before;
   auto switch_us = std::chrono::duration_cast<us>(switch_duration).count();
@@ -144,6 +170,7 @@ static void bthread_ctx_test_2(int thread_n, uint64_t switch_n) {
   }
 
   // threads
+  Profile profile(__func__, thread_n, switch_n);
   auto threads = std::vector<bthread_t>(thread_n);
   for (int i = 0; i < thread_n; ++i) {
     bthread_start_background(&threads[i], nullptr, f_ctx_switch, &args[i]);
@@ -151,6 +178,7 @@ static void bthread_ctx_test_2(int thread_n, uint64_t switch_n) {
   for (auto tid : threads) {
     bthread_join(tid, nullptr);
   }
+  profile.stop();
 
   auto switch_before = *std::min_element(switch_befores, switch_befores + thread_n);
   auto switch_after = *std::max_element(switch_afters, switch_afters + thread_n);
@@ -178,6 +206,7 @@ struct arg_worker_t {
 static void *f_urgent(void *arg) {
   // fmt::print("urgent tid: {}\n", pthread_self());
   auto urgent_start = clk::now();
+  TRACE("urgent", start, 1);
 
   // 1. Block the pthread, then scheduler will steal bthread's on current TaskGroup to
   // other pthread. Stealing won't happened if f_urgent finish quickly.
@@ -188,6 +217,7 @@ static void *f_urgent(void *arg) {
   fmt::print("{}\n", i);
 
   static_cast<arg_urgent_t *>(arg)->urgent_start = urgent_start;
+  TRACE("urgent", finish, 1);
   return nullptr;
 }
 
@@ -196,12 +226,19 @@ static void *f_worker(void *arg) {
   auto arg_urgent = static_cast<char *>(arg) + sizeof(arg_worker_t);
 
   bthread_t tid{};
+  TRACE("worker", start, 0);
   // fmt::print("worker tid before bthread_start_urgent(): {}\n", pthread_self());
+  TRACE("urgent", spawn, 1);
+  TRACE("worker", yield, 0);
   auto urgent_before = clk::now();
   bthread_start_urgent(&tid, nullptr, f_urgent, arg_urgent);
   auto urgent_after = clk::now();
+  TRACE("worker", resume, 0);
   // fmt::print("worker tid after bthread_start_urgent(): {}\n", pthread_self());
+  TRACE("worker", block, 0);
   bthread_join(tid, nullptr);
+  TRACE("worker", wake, 0);
+  TRACE("worker", finish, 0);
 
   arg_worker->urgent_before = urgent_before;
   arg_worker->urgent_after = urgent_after;
@@ -218,10 +255,12 @@ static void bthread_start_urgent_test(int thread_n) {
   // arguments
   auto arg_warp = new char[sizeof(arg_urgent_t) + sizeof(arg_worker_t)];
 
+  Profile profile(__func__, thread_n);
   bthread_t tid{};
   // create a new TaskGroup to run f_worker
   bthread_start_background(&tid, nullptr, f_worker, arg_warp);
   bthread_join(tid, nullptr);
+  profile.stop();
 
   auto arg_worker = reinterpret_cast<arg_worker_t *>(arg_warp);
   auto arg_urgent = reinterpret_cast<arg_urgent_t *>(arg_warp + sizeof(arg_worker_t));
@@ -237,7 +276,587 @@ static void bthread_start_urgent_test(int thread_n) {
   delete[] arg_warp;
 }
 
+// pipeline tests
+// Each stage is an ExecutionQueue, whose consumer bthread transforms a batch and
+// executes it on the next stage's queue. The last stage is also the sink.
+struct stage_t {
+  bthread::ExecutionQueueId<batch_t> next;
+  bool last;
+  pipeline_sink_t *sink;
+  bthread::CountdownEvent *done;
+};
+
+static int f_stage(void *meta, bthread::TaskIterator<batch_t> &iter) {
+  if (iter.is_queue_stopped()) {
+    return 0;
+  }
+  auto stage = static_cast<stage_t *>(meta);
+  TRACE("pipeline_stage", start, stage);
+  for (; iter; ++iter) {
+    for (auto &item : *iter) {
+      item = Utils::op_stage(item);
+    }
+    if (!stage->last) {
+      bthread::execution_queue_execute(stage->next, std::move(*iter));
+      continue;
+    }
+    auto died = clk::now();
+    for (auto &item : *iter) {
+      stage->sink->take(item, died);
+    }
+    stage->done->signal(iter->size());
+  }
+  TRACE("pipeline_stage", finish, stage);
+  return 0;
+}
+
+static void bthread_pipeline_test(int stage_n, int item_n, int batch_n) {
+  batch_n = std::max(batch_n, 1); // a batch of 0 would never move an item
+  pipeline_sink_t sink(stage_n, item_n);
+  bthread::CountdownEvent done(item_n);
+
+  // start queues from the sink backwards, so each stage knows its next queue.
+  auto queues = std::vector<bthread::ExecutionQueueId<batch_t>>(stage_n);
+  auto stages = std::vector<stage_t>(stage_n);
+  for (int i = stage_n - 1; i >= 0; --i) {
+    stages[i] = {i == stage_n - 1 ? queues[i] : queues[i + 1], i == stage_n - 1,
+                 &sink, &done};
+    bthread::execution_queue_start(&queues[i], nullptr, f_stage, &stages[i]);
+  }
+
+  // the calling pthread is the source.
+  Profile profile(__func__, stage_n, item_n, batch_n);
+  auto run_before = clk::now();
+  uint64_t item_next = 0;
+  for (int item_left = item_n; item_left > 0;) {
+    auto batch = batch_t(std::min(item_left, batch_n));
+    auto born = clk::now();
+    for (auto &item : batch) {
+      item = {item_next, item_next, born};
+      ++item_next;
+    }
+    item_left -= batch.size();
+    bthread::execution_queue_execute(queues[0], std::move(batch));
+  }
+  done.wait();
+  auto run_after = clk::now();
+  profile.stop();
+  auto run_duration = run_after - run_before;
+  auto run_us = std::chrono::duration_cast<us>(run_duration).count();
+
+  fmt::print("pass {} items through {} stages of execution queues in batches of {}, cost "
+             "{} us, {:.0f} items/s\n",
+             item_n, stage_n, batch_n, run_us, item_n * 1000000.0 / std::max<long>(run_us, 1));
+  sink.print(item_n);
+
+  for (auto id : queues) {
+    bthread::execution_queue_stop(id);
+  }
+  for (auto id : queues) {
+    bthread::execution_queue_join(id);
+  }
+}
+
+// stack fault tests
+static void bthread_stack_fault_test(int thread_n, bool prefault) {
+  if (prefault) {
+    fmt::print("pre-faulted stack pool is not available for bthread, which recycles its "
+               "own stacks. Run the test twice to see warm stacks.\n");
+  }
+  // FLAGS_stack_size_normal
+  std::vector<stack_probe_t> probes(thread_n, stack_probe_t{1024 * 1024, 0});
+
+  std::vector<bthread_t> threads(thread_n);
+  Profile profile(__func__, thread_n, prefault);
+  auto create_faults = Utils::minor_faults();
+  auto create_before = clk::now();
+  for (int i = 0; i < thread_n; ++i) {
+    bthread_start_background(&threads[i], nullptr, Utils::f_touch_stack, &probes[i]);
+  }
+  auto create_after = clk::now();
+  create_faults = Utils::minor_faults() - create_faults;
+  auto create_us = std::chrono::duration_cast<us>(create_after - create_before).count();
+
+  auto join_faults = Utils::minor_faults();
+  TRACE(__func__, block, 0);
+  auto join_before = clk::now();
+  for (auto tid : threads) {
+    bthread_join(tid, nullptr);
+  }
+  auto join_after = clk::now();
+  TRACE(__func__, wake, 0);
+  profile.stop();
+  join_faults = Utils::minor_faults() - join_faults;
+  auto join_us = std::chrono::duration_cast<us>(join_after - join_before).count();
+
+  fmt::print("create {} threads, cost {} us, {} minor faults\n", thread_n, create_us,
+             create_faults);
+  fmt::print("join {} threads, cost {} us, {} minor faults\n", thread_n, join_us,
+             join_faults);
+  fmt::print("{:.1f} minor faults per thread, {} stack pages resident per thread\n",
+             double(create_faults + join_faults) / thread_n, Utils::avg_stack_pages(probes));
+}
+
+// tls tests
+struct bthread_specific_storage_t {
+  static bthread_key_t key() {
+    static bthread_key_t key = []() {
+      bthread_key_t key;
+      bthread_key_create(&key, nullptr);
+      return key;
+    }();
+    return key;
+  }
+  void set(uint64_t value) { bthread_setspecific(key(), reinterpret_cast<void *>(value)); }
+  uint64_t get() { return reinterpret_cast<uint64_t>(bthread_getspecific(key())); }
+};
+
+struct args_tls_t {
+  uint64_t value;
+  int migrate_n;
+  uint64_t access_n;
+  tls_stat_t thread_local_stat;
+  tls_stat_t pthread_specific_stat;
+  tls_stat_t bthread_specific_stat;
+  tls_migrate_t migrate;
+};
+
+static void *f_hold_worker(void *migrate) {
+  static_cast<tls_migrate_t *>(migrate)->hold(ms(10));
+  return nullptr;
+}
+
+static void *f_tls(void *args) {
+  auto args_tls = static_cast<args_tls_t *>(args);
+  // bthread_start_urgent runs the holder on this worker and puts the task back into its
+  // run queue, where an idle worker steals it
+  auto yield = [args_tls]() {
+    bthread_t holder;
+    args_tls->migrate.resumed.store(false, std::memory_order_release);
+    bthread_start_urgent(&holder, nullptr, f_hold_worker, &args_tls->migrate);
+    args_tls->migrate.resumed.store(true, std::memory_order_release);
+    bthread_join(holder, nullptr);
+  };
+  for (int i = 0; i < args_tls->migrate_n; ++i) {
+    args_tls->thread_local_stat.round(thread_local_storage_t{}, args_tls->value,
+                                      args_tls->access_n, yield);
+    args_tls->pthread_specific_stat.round(pthread_specific_storage_t{}, args_tls->value,
+                                          args_tls->access_n, yield);
+    args_tls->bthread_specific_stat.round(bthread_specific_storage_t{}, args_tls->value,
+                                          args_tls->access_n, yield);
+  }
+  return nullptr;
+}
+
+static void bthread_tls_test(int thread_n, int migrate_n, uint64_t access_n) {
+  // Tasks yield between setting and getting a value while a holder blocks their worker,
+  // so that they are picked up by another worker. thread_local and pthread_getspecific
+  // then see the value that another bthread set on the new worker.
+  auto args = std::vector<args_tls_t>(thread_n);
+  for (int i = 0; i < thread_n; ++i) {
+    args[i].value = i + 1;
+    args[i].migrate_n = migrate_n;
+    args[i].access_n = access_n;
+  }
+
+  Profile profile(__func__, thread_n, migrate_n, access_n);
+  auto threads = std::vector<bthread_t>(thread_n);
+  for (int i = 0; i < thread_n; ++i) {
+    bthread_start_background(&threads[i], nullptr, f_tls, &args[i]);
+  }
+  for (auto tid : threads) {
+    bthread_join(tid, nullptr);
+  }
+  profile.stop();
+
+  tls_stat_t thread_local_stat, pthread_specific_stat, bthread_specific_stat;
+  for (auto &arg : args) {
+    thread_local_stat.merge(arg.thread_local_stat);
+    pthread_specific_stat.merge(arg.pthread_specific_stat);
+    bthread_specific_stat.merge(arg.bthread_specific_stat);
+  }
+  fmt::print("launch {} threads, yield {} times between {} accesses:\n", thread_n, migrate_n,
+             access_n);
+  thread_local_stat.print("thread_local");
+  pthread_specific_stat.print("pthread_getspecific");
+  bthread_specific_stat.print("bthread_getspecific");
+}
+
+static void bthread_queue_test(int producer_n, int consumer_n, uint64_t item_n, int batch_n) {
+  fmt::print("Not Implemented, the queue tests run in benchmark_pthread.\n");
+}
+
+// hybrid tests
+// Resume each coroutine in a new bthread.
+struct bthread_executor_t {
+  void post(std::coroutine_handle<> handle) {
+    bthread_t tid;
+    bthread_start_background(&tid, nullptr, f_resume, handle.address());
+  }
+};
+
+// Resume coroutines in order by the consumer bthread of one ExecutionQueue.
+struct execution_queue_executor_t {
+  execution_queue_executor_t() { bthread::execution_queue_start(&id, nullptr, f_execute, this); }
+  ~execution_queue_executor_t() {
+    bthread::execution_queue_stop(id);
+    bthread::execution_queue_join(id);
+  }
+
+  static int f_execute(void *meta, bthread::TaskIterator<std::coroutine_handle<>> &iter) {
+    if (iter.is_queue_stopped()) {
+      return 0;
+    }
+    for (; iter; ++iter) {
+      iter->resume();
+    }
+    return 0;
+  }
+
+  void post(std::coroutine_handle<> handle) { bthread::execution_queue_execute(id, handle); }
+
+  bthread::ExecutionQueueId<std::coroutine_handle<>> id;
+};
+
+struct args_park_t {
+  bthread::CountdownEvent *parked;
+  bthread::CountdownEvent *release;
+};
+
+static void *f_park(void *args) {
+  auto args_park = static_cast<args_park_t *>(args);
+  args_park->parked->signal();
+  args_park->release->wait();
+  return nullptr;
+}
+
+static void bthread_hybrid_test(int thread_n, uint64_t switch_n) {
+  fmt::print("native bthread:\n");
+  bthread_create_join_test(thread_n);
+  bthread_loop_test_1(thread_n);
+  bthread_ctx_switch_test_1(switch_n);
+  {
+    bthread::CountdownEvent parked(thread_n);
+    bthread::CountdownEvent release(1);
+    args_park_t args{&parked, &release};
+    auto threads = std::vector<bthread_t>(thread_n);
+    auto rss_before = Utils::rss_kb();
+    for (auto &tid : threads) {
+      bthread_start_background(&tid, nullptr, f_park, &args);
+    }
+    parked.wait();
+    auto rss_after = Utils::rss_kb();
+    release.signal();
+    for (auto tid : threads) {
+      bthread_join(tid, nullptr);
+    }
+    fmt::print("{} blocked threads hold {} KB\n", thread_n, rss_after - rss_before);
+  }
+
+  fmt::print("cpp20 coroutines on bthread_start_background:\n");
+  bthread_executor_t bthread_executor;
+  hybrid_tests(bthread_executor, "bthread", thread_n, switch_n);
+
+  fmt::print("cpp20 coroutines on ExecutionQueue:\n");
+  execution_queue_executor_t execution_queue_executor;
+  hybrid_tests(execution_queue_executor, "execution_queue", thread_n, switch_n);
+}
+
+// lifecycle test
+static void *f_started(void *started) {
+  *static_cast<time_point_t *>(started) = clk::now();
+  return nullptr;
+}
+
+// bthread workers start with the first bthread and are never stopped, so only the first
+// round in a process is a cold start; later rounds show the warm dispatch.
+static void bthread_lifecycle_test(int worker_n) {
+  for (int round = 0; round < 3; ++round) {
+    time_point_t started;
+    bthread_t tid;
+    Profile profile(__func__, worker_n, round);
+    auto start_before = clk::now();
+    if (round == 0) {
+      if (int rc = bthread_setconcurrency(worker_n)) {
+        fmt::print("bthread_setconcurrency({}) failed: {}\n", worker_n, rc);
+      }
+    }
+    bthread_start_background(&tid, nullptr, f_started, &started);
+    bthread_join(tid, nullptr);
+    profile.stop();
+    auto startup_us = std::chrono::duration_cast<us>(started - start_before).count();
+    fmt::print("round {}: {} workers, first bthread after {} us\n", round,
+               bthread_getconcurrency(), startup_us);
+  }
+  fmt::print("bthread workers can't be stopped, no shutdown cost\n");
+}
+
+// A bthread returns its stack and TaskMeta to the pools when it exits; the join of an
+// exited bthread only checks its version.
+static void bthread_teardown_test(int thread_n, int repeat_n) {
+  std::vector<bthread_t> threads(thread_n);
+  reclaim_stat_t stat(repeat_n);
+  for (int round = 0; round < repeat_n; ++round) {
+    std::atomic<int> done{0};
+    for (auto &tid : threads) {
+      bthread_start_background(&tid, nullptr, Utils::f_count, &done);
+    }
+    while (done.load() < thread_n) {
+      bthread_usleep(10);
+    }
+
+    Profile profile(__func__, thread_n, round);
+    auto destroy_before = clk::now();
+    for (auto tid : threads) {
+      bthread_join(tid, nullptr);
+    }
+    auto destroy_after = clk::now();
+    profile.stop();
+    stat.round(thread_n, destroy_after - destroy_before);
+  }
+  stat.print();
+}
+
+// bthread can add workers but never remove them, and it starts with its default count
+// (--bthread_concurrency) on the first bthread. So the sweep sets the concurrency of each
+// point, from the fewest workers up, and must be the first bthread test of the process
+// for the low points to run. A point bthread can't run with, fewer workers than it has
+// already or than its minimum, is skipped rather than measured with the wrong count.
+static void bthread_oversubscribe_test(int task_n, uint64_t work_n) {
+  std::vector<bthread_t> threads(task_n);
+  oversubscribe_sweep(task_n, work_n, [&](int worker_n, oversubscribe_run_t &point) {
+    if (worker_n != bthread_getconcurrency()) {
+      if (int rc = bthread_setconcurrency(worker_n)) {
+        fmt::print("bthread_setconcurrency({}) failed: {}\n", worker_n, rc);
+      }
+    }
+    if (worker_n != bthread_getconcurrency()) {
+      fmt::print("skip {} workers, bthread runs {}; run this test first in the process\n",
+                 worker_n, bthread_getconcurrency());
+      return false;
+    }
+    Profile profile("bthread_oversubscribe_test", task_n, worker_n);
+    point.start();
+    for (int i = 0; i < task_n; ++i) {
+      bthread_start_background(&threads[i], nullptr, Utils::f_spin, point.submit(i));
+    }
+    for (auto tid : threads) {
+      bthread_join(tid, nullptr);
+    }
+    point.stop();
+    profile.stop();
+    return true;
+  });
+}
+
+// join tests
+static void *f_signal(void *event) {
+  static_cast<bthread::CountdownEvent *>(event)->signal();
+  return nullptr;
+}
+
+static void bthread_join_test(int max_n) {
+  for (auto thread_n : Utils::join_sizes(max_n)) {
+    std::vector<bthread_t> threads(thread_n);
+    {
+      Profile profile(__func__, "bthread_join", thread_n);
+      auto launch_before = clk::now();
+      for (auto &tid : threads) {
+        bthread_start_background(&tid, nullptr, Utils::f_null, nullptr);
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      for (auto tid : threads) {
+        bthread_join(tid, nullptr);
+      }
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("bthread_join", thread_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+    {
+      bthread::CountdownEvent event(thread_n);
+      Profile profile(__func__, "CountdownEvent", thread_n);
+      auto launch_before = clk::now();
+      for (auto &tid : threads) {
+        bthread_start_background(&tid, nullptr, f_signal, &event);
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      event.wait();
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("CountdownEvent", thread_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+  }
+}
+
+static void bthread_false_sharing_test(int thread_n, uint64_t write_n) {
+  false_sharing_sweep(__func__, thread_n, write_n, [=](std::vector<sharing_args_t> &args) {
+    std::vector<bthread_t> threads(thread_n);
+    for (int i = 0; i < thread_n; ++i) {
+      bthread_start_background(&threads[i], nullptr, Utils::f_write, &args[i]);
+    }
+    for (auto tid : threads) {
+      bthread_join(tid, nullptr);
+    }
+  });
+}
+
+// allocation tests
+static void f_yield() { bthread_yield(); }
+
+static void bthread_alloc_test(int thread_n, uint64_t alloc_n) {
+  alloc_run_t run(thread_n, alloc_n);
+  std::vector<args_alloc_t> args(thread_n);
+  for (int i = 0; i < thread_n; ++i) {
+    args[i] = {&run.tasks[i], &run.exchange};
+  }
+  std::vector<bthread_t> threads(thread_n);
+
+  Profile profile(__func__, thread_n, alloc_n);
+  run.start();
+  for (int i = 0; i < thread_n; ++i) {
+    bthread_start_background(&threads[i], nullptr, f_alloc<f_yield>, &args[i]);
+  }
+  for (auto tid : threads) {
+    bthread_join(tid, nullptr);
+  }
+  run.stop();
+  profile.stop();
+  run.print(thread_n);
+}
+
+// scatter-gather tests: a bthread timer stops the stragglers at the deadline, bthread_stop
+// interrupts their bthread_usleep
+struct bthread_request_t : scatter_request_t {
+  bthread_request_t(int fanout_k, us deadline, std::mt19937_64 &random)
+      : scatter_request_t(fanout_k, deadline, random), tids(fanout_k), gathered(fanout_k) {}
+
+  std::vector<bthread_t> tids;
+  bthread::CountdownEvent gathered;
+  time_point_t cancel_before;
+  std::atomic<bool> fired{false};
+};
+
+static void *f_scatter(void *args) {
+  auto args_scatter = static_cast<args_scatter_t *>(args);
+  auto request = static_cast<bthread_request_t *>(args_scatter->request);
+  TRACE("scatter_sub_task", start, args_scatter);
+  if (bthread_usleep(request->latencies[args_scatter->index].count()) != 0) {
+    ++request->cancelled_n;
+  }
+  ++request->finished_n;
+  TRACE("scatter_sub_task", finish, args_scatter);
+  request->gathered.signal();
+  return nullptr;
+}
+
+static void f_deadline(void *arg) {
+  auto request = static_cast<bthread_request_t *>(arg);
+  request->cancel_before = clk::now();
+  // stopping a sub-task that already ended is a no-op
+  for (auto tid : request->tids) {
+    bthread_stop(tid);
+  }
+  request->fired.store(true, std::memory_order_release);
+}
+
+static void bthread_scatter_gather_test(int request_n, int fanout_k, uint64_t deadline_us) {
+  auto deadline = us(deadline_us);
+  for (auto k : scatter_stat_t::fanouts(fanout_k)) {
+    scatter_stat_t stat(k);
+    std::mt19937_64 random(k);
+    Profile profile(__func__, k, deadline_us);
+    for (int i = 0; i < request_n; ++i) {
+      bthread_request_t request(k, deadline, random);
+      std::vector<args_scatter_t> args(k);
+      auto request_before = clk::now();
+      for (int j = 0; j < k; ++j) {
+        args[j] = {&request, j};
+        bthread_start_background(&request.tids[j], nullptr, f_scatter, &args[j]);
+        TRACE(__func__, spawn, &args[j]);
+      }
+      auto deadline_ns = std::chrono::duration_cast<ns>(
+          (request_before + deadline).time_since_epoch()).count();
+      timespec abstime{time_t(deadline_ns / 1000000000), long(deadline_ns % 1000000000)};
+      bthread_timer_t timer;
+      bthread_timer_add(&timer, abstime, f_deadline, &request);
+      TRACE(__func__, block, &request);
+      request.gathered.wait();
+      auto gather_after = clk::now();
+      TRACE(__func__, wake, &request);
+
+      // a timer that could not be deleted has run, or is still stopping the sub-tasks
+      auto fired = bthread_timer_del(timer) != 0;
+      while (fired && !request.fired.load(std::memory_order_acquire)) {
+        bthread_yield();
+      }
+      // the timer also fires when the last sub-task ends just before it, the outcome is
+      // what tells a miss
+      auto missed = request.cancelled_n > 0 || gather_after > request_before + deadline;
+      auto request_after = fired ? std::min(request.cancel_before, gather_after) : gather_after;
+      stat.round(request_after - request_before, missed, gather_after - request_after,
+                 request.cancelled_n);
+    }
+    profile.stop();
+    stat.print(deadline);
+  }
+}
+
+// inline tests
+struct bthread_backend_t {
+  using handle_t = bthread_t;
+  static const char *name() { return "bthread"; }
+
+  template <typename Body> static bthread_t spawn(Body, int *data) {
+    bthread_t tid;
+    bthread_start_background(&tid, nullptr, f_body<Body>, data);
+    return tid;
+  }
+
+  static void join(bthread_t &tid) { bthread_join(tid, nullptr); }
+
+  struct switch_args_t {
+    int *data;
+    uint64_t switch_n;
+    ns duration;
+  };
+
+  template <typename Body> static void *f_switch(void *args) {
+    auto switch_args = static_cast<switch_args_t *>(args);
+    Body body;
+    auto switch_before = clk::now();
+    for (auto switch_left = switch_args->switch_n; switch_left--;) {
+      body(switch_args->data);
+      bthread_yield();
+    }
+    switch_args->duration = std::chrono::duration_cast<ns>(clk::now() - switch_before);
+    return nullptr;
+  }
+
+  template <typename Body> static ns switch_loop(Body, int *data, uint64_t switch_n) {
+    switch_args_t args{data, switch_n, ns{0}};
+    bthread_t tid;
+    bthread_start_background(&tid, nullptr, f_switch<Body>, &args);
+    bthread_join(tid, nullptr);
+    return args.duration;
+  }
+};
+
+static void bthread_inline_test(int thread_n, uint64_t switch_n) {
+  inline_tests<bthread_backend_t>(thread_n, switch_n);
+}
+
 Benchmark benchmark{
     bthread_create_join_test,  bthread_loop_test_1, bthread_loop_test_2,
     bthread_ctx_switch_test_1, bthread_ctx_test_2,  bthread_start_urgent_test,
+    bthread_pipeline_test,     bthread_stack_fault_test,  bthread_tls_test,
+    bthread_queue_test,        bthread_hybrid_test,       bthread_lifecycle_test,
+    bthread_teardown_test,     bthread_oversubscribe_test, bthread_join_test,
+    bthread_false_sharing_test, bthread_alloc_test, bthread_scatter_gather_test,
+    bthread_inline_test,
 };
\ No newline at end of file
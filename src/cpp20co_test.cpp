@@ -1,8 +1,21 @@
+#include "alloc.h"
 #include "benchmark.h"
+#include "executor.h"
+#include "hybrid.h"
+#include "inline.h"
+#include "scatter.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <barrier>
 #include <cassert>
 #include <coroutine>
 #include <fmt/core.h>
 #include <memory>
+#include <queue>
+#include <random>
+#include <thread>
+#include <utility>
 #include <vector>
 
 // the same coroutine semantic as libco
@@ -24,14 +37,107 @@ struct promise {
 };
 // coroutine semantic
 
+// Coroutine frames from a pre-faulted free list, recycled across tests. Frames
+// larger than a block fall back to operator new.
+struct frame_pool_t {
+  static const size_t block_size = 256;
+
+  void *allocate(size_t size) {
+    frame_size = size;
+    if (size > block_size) {
+      return ::operator new(size);
+    }
+    if (blocks.empty()) {
+      prefault(1024);
+    }
+    auto block = blocks.back();
+    blocks.pop_back();
+    return block;
+  }
+
+  void deallocate(void *frame, size_t size) {
+    if (size > block_size) {
+      ::operator delete(frame);
+      return;
+    }
+    blocks.push_back(frame);
+  }
+
+  // grow the pool by block_n blocks and touch all of them
+  void prefault(size_t block_n) {
+    blocks.reserve(blocks.size() + block_n);
+    auto slab = new char[block_n * block_size];
+    std::fill(slab, slab + block_n * block_size, 0);
+    for (size_t i = 0; i < block_n; ++i) {
+      blocks.push_back(slab + i * block_size);
+    }
+  }
+
+  std::vector<void *> blocks;
+  size_t frame_size = 0;
+};
+
+static frame_pool_t frame_pool;
+
+struct pooled_promise;
+struct pooled_coroutine : std::coroutine_handle<pooled_promise> {
+  using promise_type = struct pooled_promise;
+};
+
+struct pooled_promise : promise {
+  pooled_coroutine get_return_object() { return {pooled_coroutine::from_promise(*this)}; }
+  static void *operator new(size_t size) { return frame_pool.allocate(size); }
+  static void operator delete(void *frame, size_t size) { frame_pool.deallocate(frame, size); }
+};
+
+// pull-based generator: next() resumes the producer until its next co_yield.
+template <typename T> struct generator {
+  struct promise_type {
+    T current;
+    generator get_return_object() {
+      return generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(T value) {
+      current = std::move(value);
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() {}
+  };
+
+  explicit generator(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+  generator(generator &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  generator &operator=(generator &&other) noexcept {
+    std::swap(handle, other.handle);
+    return *this;
+  }
+  ~generator() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  bool next() {
+    handle.resume();
+    return !handle.done();
+  }
+  T &value() { return handle.promise().current; }
+
+  std::coroutine_handle<promise_type> handle;
+};
+
 static void cpp20co_create_join_test(int coroutine_n) {
   std::vector<coroutine> coroutines(coroutine_n);
+  Profile profile(__func__, coroutine_n);
   auto create_before = clk::now();
   for (auto &tid : coroutines) {
     tid = []() -> coroutine {
       Utils::f_null(nullptr);
       co_return;
     }();
+    TRACE(__func__, spawn, tid.address());
   }
   auto create_after = clk::now();
   auto create_duration = create_after - create_before;
@@ -42,29 +148,35 @@ static void cpp20co_create_join_test(int coroutine_n) {
 
   auto resume_before = clk::now();
   for (auto &tid : coroutines) {
+    TRACE(__func__, start, tid.address());
     tid.resume();
+    TRACE(__func__, finish, tid.address());
   }
   auto resume_after = clk::now();
+  profile.stop();
   auto resume_duration = resume_after - resume_before;
   auto resume_us = std::chrono::duration_cast<us>(resume_duration).count();
   auto resume_ns = std::chrono::duration_cast<ns>(resume_duration).count();
   fmt::print("resume {} coroutines, cost {} us, {} ns\n", coroutine_n, resume_us,
              resume_ns);
 
-  // destroy by RAII
+  for (auto &tid : coroutines) {
+    tid.destroy();
+  }
 }
 
 static void cpp20co_loop_test_1(int coroutine_n) {
-  std::vector<int> datas(coroutine_n, 10);
-  std::vector<int> results(coroutine_n);
-  std::transform(datas.begin(), datas.end(), results.begin(), Utils::op_mul_1<int>);
+  loop_layout_t datas(coroutine_n);
+  std::vector<int> results(coroutine_n, 10);
+  std::transform(results.begin(), results.end(), results.begin(), Utils::op_mul_1<int>);
 
   std::vector<coroutine> coroutines(coroutine_n);
 
+  Profile profile(__func__, coroutine_n);
   auto run_before = clk::now();
   for (int i = 0; i < coroutine_n; ++i) {
     coroutines[i] = [&]() -> coroutine {
-      Utils::f_mul_1(&datas[i]);
+      datas.task()(datas.data(i));
       co_return;
     }();
     // co_resume(coroutines[i]);
@@ -76,16 +188,23 @@ static void cpp20co_loop_test_1(int coroutine_n) {
   for (auto &tid : coroutines) {
     tid.resume();
   }
+  datas.merge();
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
   fmt::print(
-      "launch {} coroutines to multiply a vector to a scalar, end-to-end cost {} us\n",
-      coroutine_n, run_us);
+      "launch {} coroutines to multiply a vector to a scalar, {} layout, end-to-end cost {} "
+      "us\n",
+      coroutine_n, datas.layout, run_us);
 
   // Should access datas, otherwise compiler may optimized the * operations.
-  assert(datas == results);
+  assert(datas.values() == results);
+
+  for (auto &tid : coroutines) {
+    tid.destroy();
+  }
 }
 
 static void cpp20co_loop_test_2(int coroutine_n) {
@@ -96,6 +215,7 @@ static void cpp20co_loop_test_2(int coroutine_n) {
 
   std::vector<coroutine> coroutines(coroutine_n);
 
+  Profile profile(__func__, coroutine_n);
   auto run_before = clk::now();
   for (int i = 0; i < coroutine_n; ++i) {
     coroutines[i] = [&]() -> coroutine {
@@ -112,6 +232,7 @@ static void cpp20co_loop_test_2(int coroutine_n) {
     tid.resume();
   }
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
@@ -120,16 +241,25 @@ static void cpp20co_loop_test_2(int coroutine_n) {
       coroutine_n, run_us);
 
   assert(datas == results);
+
+  for (auto &tid : coroutines) {
+    tid.destroy();
+  }
 }
 
 static void cpp20co_ctx_switch_test_1(uint64_t switch_n) {
   auto co = [](uint64_t switch_n) -> coroutine {
+    TRACE("ctx_switch", start, 0);
     while (switch_n--) {
+      TRACE("ctx_switch", yield, 0);
       co_await std::suspend_always{};
+      TRACE("ctx_switch", resume, 0);
     }
+    TRACE("ctx_switch", finish, 0);
     co_return;
   }(switch_n);
 
+  Profile profile(__func__, switch_n);
   auto switch_before = clk::now();
 
   auto switch_left = switch_n;
@@ -138,13 +268,14 @@ static void cpp20co_ctx_switch_test_1(uint64_t switch_n) {
   }
 
   auto switch_after = clk::now();
+  profile.stop();
   auto switch_duration = switch_after - switch_before;
   auto switch_us = std::chrono::duration_cast<us>(switch_duration).count();
 
   fmt::print("launch 1 coroutines, switch in-and-out {} times, cost {} us.\n",
              (uint64_t)switch_n, switch_us);
 
-  // co destroyed by RAII
+  co.destroy();
 }
 
 static void cpp20co_ctx_switch_test_2(int coroutine_n, uint64_t switch_n) {
@@ -153,7 +284,623 @@ static void cpp20co_ctx_switch_test_2(int coroutine_n, uint64_t switch_n) {
 
 static void cpp20co_long_callback_test(int coroutine_n) {}
 
+// pipeline tests
+static generator<batch_t> pipeline_source(int item_n, int batch_n) {
+  uint64_t item_next = 0;
+  while (item_n > 0) {
+    auto batch = batch_t(std::min(item_n, batch_n));
+    auto born = clk::now();
+    for (auto &item : batch) {
+      item = {item_next, item_next, born};
+      ++item_next;
+    }
+    item_n -= batch.size();
+    co_yield std::move(batch);
+  }
+}
+
+static generator<batch_t> pipeline_stage(generator<batch_t> upstream) {
+  while (upstream.next()) {
+    auto batch = std::move(upstream.value());
+    TRACE("pipeline_stage", resume, &upstream);
+    for (auto &item : batch) {
+      item = Utils::op_stage(item);
+    }
+    TRACE("pipeline_stage", yield, &upstream);
+    co_yield std::move(batch);
+  }
+}
+
+static void cpp20co_pipeline_test(int stage_n, int item_n, int batch_n) {
+  // source -> stage_n transform stages -> sink, each stage pulls from the upstream
+  // generator, so one item batch travels the whole chain per sink pull.
+  batch_n = std::max(batch_n, 1); // a batch of 0 would never move an item
+  pipeline_sink_t sink(stage_n, item_n);
+
+  Profile profile(__func__, stage_n, item_n, batch_n);
+  auto run_before = clk::now();
+  auto pipeline = pipeline_source(item_n, batch_n);
+  for (int i = 0; i < stage_n; ++i) {
+    pipeline = pipeline_stage(std::move(pipeline));
+  }
+  while (pipeline.next()) {
+    auto died = clk::now();
+    for (auto &item : pipeline.value()) {
+      sink.take(item, died);
+    }
+  }
+  auto run_after = clk::now();
+  profile.stop();
+  auto run_duration = run_after - run_before;
+  auto run_us = std::chrono::duration_cast<us>(run_duration).count();
+
+  fmt::print("pass {} items through {} stages of generators in batches of {}, cost {} us, "
+             "{:.0f} items/s\n",
+             item_n, stage_n, batch_n, run_us, item_n * 1000000.0 / std::max<long>(run_us, 1));
+  sink.print(item_n);
+}
+
+// stack fault tests
+// Stackless coroutines have no stack of their own, so the faults measured here are
+// taken on the heap frames (default) or on the frame pool (prefault).
+template <typename Coroutine> static void stack_fault_test(int coroutine_n, bool prefault) {
+  std::vector<Coroutine> coroutines(coroutine_n);
+  Profile profile("cpp20co_stack_fault_test", coroutine_n, prefault);
+  auto create_faults = Utils::minor_faults();
+  auto create_before = clk::now();
+  for (auto &tid : coroutines) {
+    tid = []() -> Coroutine {
+      Utils::f_null(nullptr);
+      co_return;
+    }();
+  }
+  auto create_after = clk::now();
+  create_faults = Utils::minor_faults() - create_faults;
+  auto create_us = std::chrono::duration_cast<us>(create_after - create_before).count();
+
+  auto resume_faults = Utils::minor_faults();
+  auto resume_before = clk::now();
+  for (auto &tid : coroutines) {
+    tid.resume();
+  }
+  auto resume_after = clk::now();
+  profile.stop();
+  resume_faults = Utils::minor_faults() - resume_faults;
+  auto resume_us = std::chrono::duration_cast<us>(resume_after - resume_before).count();
+
+  fmt::print("create {} coroutines on {} frames, cost {} us, {} minor faults\n",
+             coroutine_n, prefault ? "pre-faulted" : "default", create_us, create_faults);
+  fmt::print("resume {} coroutines, cost {} us, {} minor faults\n", coroutine_n, resume_us,
+             resume_faults);
+  fmt::print("{:.1f} minor faults per coroutine, no stack pages\n",
+             double(create_faults + resume_faults) / coroutine_n);
+
+  for (auto &tid : coroutines) {
+    tid.destroy();
+  }
+}
+
+static void cpp20co_stack_fault_test(int coroutine_n, bool prefault) {
+  if (!prefault) {
+    stack_fault_test<coroutine>(coroutine_n, prefault);
+    return;
+  }
+  if (frame_pool.blocks.size() < size_t(coroutine_n)) {
+    auto pool_before = Utils::minor_faults();
+    frame_pool.prefault(coroutine_n - frame_pool.blocks.size());
+    fmt::print("grow frame pool to {} blocks, {} minor faults\n", frame_pool.blocks.size(),
+               Utils::minor_faults() - pool_before);
+  }
+  stack_fault_test<pooled_coroutine>(coroutine_n, prefault);
+  fmt::print("frame size {} bytes\n", frame_pool.frame_size);
+}
+
+// tls tests
+// A request context carried by the promise, reached through an awaitable that never
+// suspends, so it moves with the coroutine whichever thread resumes it.
+struct context_promise;
+struct context_coroutine : std::coroutine_handle<context_promise> {
+  using promise_type = struct context_promise;
+};
+
+struct context_promise : promise {
+  context_coroutine get_return_object() { return {context_coroutine::from_promise(*this)}; }
+  uint64_t context = 0;
+};
+
+struct get_promise_t {
+  bool await_ready() { return false; }
+  bool await_suspend(std::coroutine_handle<context_promise> handle) {
+    self = &handle.promise();
+    return false;
+  }
+  context_promise &await_resume() { return *self; }
+  context_promise *self;
+};
+
+struct promise_context_storage_t {
+  void set(uint64_t value) { self->context = value; }
+  uint64_t get() { return self->context; }
+  context_promise *self;
+};
+
+struct tls_stats_t {
+  tls_stat_t thread_local_stat;
+  tls_stat_t pthread_specific_stat;
+  tls_stat_t promise_context_stat;
+};
+
+static context_coroutine tls_task(uint64_t value, int migrate_n, uint64_t access_n,
+                                  tls_stats_t &stats) {
+  auto &self = co_await get_promise_t{};
+  for (int i = 0; i < migrate_n; ++i) {
+    stats.thread_local_stat.set_phase(thread_local_storage_t{}, value, access_n);
+    co_await std::suspend_always{};
+    stats.thread_local_stat.get_phase(thread_local_storage_t{}, value, access_n);
+
+    stats.pthread_specific_stat.set_phase(pthread_specific_storage_t{}, value, access_n);
+    co_await std::suspend_always{};
+    stats.pthread_specific_stat.get_phase(pthread_specific_storage_t{}, value, access_n);
+
+    stats.promise_context_stat.set_phase(promise_context_storage_t{&self}, value, access_n);
+    co_await std::suspend_always{};
+    stats.promise_context_stat.get_phase(promise_context_storage_t{&self}, value, access_n);
+  }
+}
+
+static void cpp20co_tls_test(int coroutine_n, int migrate_n, uint64_t access_n) {
+  // Every resume happens on a new thread, so each coroutine migrates at every
+  // suspension point.
+  auto stats = std::vector<tls_stats_t>(coroutine_n);
+  std::vector<context_coroutine> coroutines(coroutine_n);
+  for (int i = 0; i < coroutine_n; ++i) {
+    coroutines[i] = tls_task(i + 1, migrate_n, access_n, stats[i]);
+  }
+
+  Profile profile(__func__, coroutine_n, migrate_n, access_n);
+  for (auto &tid : coroutines) {
+    while (!tid.done()) {
+      std::thread([&]() { tid.resume(); }).join();
+    }
+  }
+  profile.stop();
+
+  tls_stats_t total;
+  for (auto &stat : stats) {
+    total.thread_local_stat.merge(stat.thread_local_stat);
+    total.pthread_specific_stat.merge(stat.pthread_specific_stat);
+    total.promise_context_stat.merge(stat.promise_context_stat);
+  }
+  fmt::print("launch {} coroutines, migrate {} times between {} accesses:\n", coroutine_n,
+             migrate_n, access_n);
+  total.thread_local_stat.print("thread_local");
+  total.pthread_specific_stat.print("pthread_getspecific");
+  total.promise_context_stat.print("promise context");
+
+  for (auto &tid : coroutines) {
+    tid.destroy();
+  }
+}
+
+static void cpp20co_queue_test(int producer_n, int consumer_n, uint64_t item_n, int batch_n) {
+  fmt::print("Not Implemented, the queue tests run in benchmark_pthread.\n");
+}
+
+// hybrid tests
+// Resume coroutines on the in-repo pthread pool, the reference for the library pools.
+struct thread_pool_executor_t {
+  void post(std::coroutine_handle<> handle) { pool.post(f_resume, handle.address()); }
+  thread_pool_t &pool;
+};
+
+static void cpp20co_hybrid_test(int coroutine_n, uint64_t switch_n) {
+  fmt::print("cpp20 coroutines resumed inline:\n");
+  cpp20co_create_join_test(coroutine_n);
+  cpp20co_loop_test_1(coroutine_n);
+  cpp20co_ctx_switch_test_1(switch_n);
+
+  fmt::print("cpp20 coroutines on thread pool:\n");
+  thread_pool_t pool(Utils::cpu_count());
+  thread_pool_executor_t executor{pool};
+  hybrid_tests(executor, "thread_pool", coroutine_n, switch_n);
+}
+
+// cpp20 coroutines have no scheduler of their own, measure the thread pool they are
+// resumed on: startup to the first coroutine resumed by a worker, then shutdown.
+static void cpp20co_lifecycle_test(int worker_n) {
+  for (int round = 0; round < 3; ++round) {
+    thread_pool_t pool;
+    thread_pool_executor_t executor{pool};
+    std::latch done(1);
+    auto tid = [](thread_pool_executor_t &executor, std::latch &done) -> hybrid_coroutine {
+      co_await schedule_on(executor);
+      done.count_down();
+    }(executor, done);
+
+    Profile profile(__func__, worker_n, round);
+    auto start_before = clk::now();
+    pool.start(worker_n);
+    tid.resume();
+    done.wait();
+    auto start_after = clk::now();
+    auto shutdown = pool.stop();
+    profile.stop();
+    auto startup_us = std::chrono::duration_cast<us>(start_after - start_before).count();
+    fmt::print("round {}: start a pool of {} threads, first coroutine after {} us, stop cost "
+               "{} us\n",
+               round, worker_n, startup_us, std::chrono::duration_cast<us>(shutdown).count());
+  }
+}
+
+// The frames stop at final_suspend, so destroy() is what frees them.
+static void cpp20co_teardown_test(int coroutine_n, int repeat_n) {
+  std::vector<coroutine> coroutines(coroutine_n);
+  reclaim_stat_t stat(repeat_n);
+  for (int round = 0; round < repeat_n; ++round) {
+    for (auto &tid : coroutines) {
+      tid = []() -> coroutine {
+        Utils::f_null(nullptr);
+        co_return;
+      }();
+      tid.resume();
+    }
+
+    Profile profile(__func__, coroutine_n, round);
+    auto destroy_before = clk::now();
+    for (auto &tid : coroutines) {
+      tid.destroy();
+    }
+    auto destroy_after = clk::now();
+    profile.stop();
+    stat.round(coroutine_n, destroy_after - destroy_before);
+  }
+  stat.print();
+}
+
+static void cpp20co_oversubscribe_test(int task_n, uint64_t work_n) {
+  fmt::print("Not Implemented, benchmark_pthread runs it on the in-repo thread pool.\n");
+}
+
+// join tests
+// Children of a when_all count themselves done, the last one resumes the parent.
+struct join_counter_t {
+  void done() {
+    if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      parent.resume();
+    }
+  }
+
+  std::atomic<int> count;
+  std::coroutine_handle<> parent{};
+};
+
+// `co_await when_all_t{&children, &counter}` starts the children and suspends the
+// parent until all of them are done.
+struct when_all_t {
+  bool await_ready() { return children->empty(); }
+  void await_suspend(std::coroutine_handle<> handle) {
+    counter->parent = handle;
+    // the last child may resume and end the parent, and this awaiter with it, before
+    // the loop is over
+    auto starting = children;
+    for (auto &child : *starting) {
+      child.resume();
+    }
+  }
+  void await_resume() {}
+
+  std::vector<hybrid_coroutine> *children;
+  join_counter_t *counter;
+};
+
+static void cpp20co_join_test(int max_n) {
+  thread_pool_t pool(Utils::cpu_count());
+  thread_pool_executor_t executor{pool};
+  for (auto coroutine_n : Utils::join_sizes(max_n)) {
+    std::vector<hybrid_coroutine> coroutines(coroutine_n);
+    {
+      std::latch done(coroutine_n);
+      Profile profile(__func__, "latch", coroutine_n);
+      auto launch_before = clk::now();
+      for (auto &tid : coroutines) {
+        tid = [](thread_pool_executor_t &executor, std::latch &done) -> hybrid_coroutine {
+          co_await schedule_on(executor);
+          Utils::f_null(nullptr);
+          done.count_down();
+        }(executor, done);
+        tid.resume();
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      done.wait();
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("std::latch", coroutine_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+    // arrive() in libstdc++'s std::barrier gets slower as the expected count grows
+    if (coroutine_n <= 10000) {
+      std::barrier<> done(coroutine_n + 1);
+      Profile profile(__func__, "barrier", coroutine_n);
+      auto launch_before = clk::now();
+      for (auto &tid : coroutines) {
+        tid = [](thread_pool_executor_t &executor, std::barrier<> &done) -> hybrid_coroutine {
+          co_await schedule_on(executor);
+          Utils::f_null(nullptr);
+          // arrive without waiting, a waiting child would block its worker
+          auto token = done.arrive();
+          (void)token;
+        }(executor, done);
+        tid.resume();
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      done.arrive_and_wait();
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("std::barrier", coroutine_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+    {
+      join_counter_t counter{{coroutine_n}, {}};
+      std::latch joined(1);
+      Profile profile(__func__, "when_all", coroutine_n);
+      auto launch_before = clk::now();
+      for (auto &tid : coroutines) {
+        tid = [](thread_pool_executor_t &executor, join_counter_t &counter) -> hybrid_coroutine {
+          co_await schedule_on(executor);
+          Utils::f_null(nullptr);
+          counter.done();
+        }(executor, counter);
+      }
+      auto parent = [](std::vector<hybrid_coroutine> &children, join_counter_t &counter,
+                       std::latch &joined) -> hybrid_coroutine {
+        co_await when_all_t{&children, &counter};
+        joined.count_down();
+      }(coroutines, counter, joined);
+      parent.resume();
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      joined.wait();
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("when_all", coroutine_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+  }
+}
+
+// false sharing tests: every coroutine writes its counter on whichever worker of the pool
+// resumes it
+static void cpp20co_false_sharing_test(int coroutine_n, uint64_t write_n) {
+  thread_pool_t pool(Utils::cpu_count());
+  thread_pool_executor_t executor{pool};
+  false_sharing_sweep(__func__, coroutine_n, write_n, [&](std::vector<sharing_args_t> &args) {
+    std::latch done(coroutine_n);
+    for (auto &arg : args) {
+      auto tid = [](thread_pool_executor_t &executor, sharing_args_t &arg,
+                    std::latch &done) -> hybrid_coroutine {
+        co_await schedule_on(executor);
+        Utils::f_write(&arg);
+        done.count_down();
+      }(executor, arg, done);
+      tid.resume();
+    }
+    done.wait();
+  });
+}
+
+// allocation tests: every step is resumed by whichever worker of the pool pops it
+static void cpp20co_alloc_test(int coroutine_n, uint64_t alloc_n) {
+  thread_pool_t pool(Utils::cpu_count());
+  thread_pool_executor_t executor{pool};
+  alloc_run_t run(coroutine_n, alloc_n);
+  std::latch done(coroutine_n);
+
+  Profile profile(__func__, coroutine_n, alloc_n);
+  run.start();
+  for (auto &task : run.tasks) {
+    auto tid = [](thread_pool_executor_t &executor, alloc_task_t &task,
+                  mpmc_queue_t<void *> &exchange, std::latch &done) -> hybrid_coroutine {
+      do {
+        co_await schedule_on(executor);
+      } while (task.step(exchange));
+      done.count_down();
+    }(executor, task, run.exchange, done);
+    tid.resume();
+  }
+  done.wait();
+  run.stop();
+  profile.stop();
+  run.print(coroutine_n);
+}
+
+// scatter-gather tests
+// Timers run in order on the calling thread, sleeping until each one is due.
+struct timer_loop_t {
+  struct timer_t {
+    bool operator>(const timer_t &other) const { return at > other.at; }
+    time_point_t at;
+    void *(*fn)(void *);
+    void *arg;
+  };
+
+  void add(time_point_t at, void *(*fn)(void *), void *arg) { timers.push({at, fn, arg}); }
+
+  void run_until(const bool &done) {
+    while (!done && !timers.empty()) {
+      auto timer = timers.top();
+      timers.pop();
+      std::this_thread::sleep_until(timer.at);
+      timer.fn(timer.arg);
+    }
+  }
+
+  void clear() { timers = {}; }
+
+  std::priority_queue<timer_t, std::vector<timer_t>, std::greater<timer_t>> timers;
+};
+
+// `co_await sleep_for_t{loop, latency}` resumes the coroutine from a timer of loop
+struct sleep_for_t {
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    loop.add(clk::now() + latency, f_resume, handle.address());
+  }
+  void await_resume() {}
+
+  timer_loop_t &loop;
+  us latency;
+};
+
+// Children count themselves done like join_counter_t, the deadline resumes the parent
+// if they don't make it.
+struct gather_t {
+  void done() {
+    if (--left == 0 && !gathered) {
+      gathered = true;
+      parent.resume();
+    }
+  }
+
+  static void *f_deadline(void *gather) {
+    auto self = static_cast<gather_t *>(gather);
+    if (!self->gathered) {
+      self->gathered = self->missed = true;
+      self->parent.resume();
+    }
+    return nullptr;
+  }
+
+  int left;
+  bool gathered = false;
+  bool missed = false;
+  std::coroutine_handle<> parent{};
+};
+
+// `co_await when_all_until_t{&children, &gather, &loop, deadline}` starts the children
+// and suspends the parent until all of them are done or the deadline is due.
+struct when_all_until_t {
+  bool await_ready() { return children->empty(); }
+  void await_suspend(std::coroutine_handle<> handle) {
+    gather->parent = handle;
+    loop->add(deadline, gather_t::f_deadline, gather);
+    // children suspend in sleep_for_t, none of them resumes the parent from here
+    for (auto &child : *children) {
+      child.resume();
+    }
+  }
+  void await_resume() {}
+
+  std::vector<coroutine> *children;
+  gather_t *gather;
+  timer_loop_t *loop;
+  time_point_t deadline;
+};
+
+// stragglers are suspended in a sleep, cancelling one is destroying its frame
+static void cpp20co_scatter_gather_test(int request_n, int fanout_k, uint64_t deadline_us) {
+  timer_loop_t loop;
+  auto deadline = us(deadline_us);
+  for (auto k : scatter_stat_t::fanouts(fanout_k)) {
+    scatter_stat_t stat(k);
+    std::mt19937_64 random(k);
+    Profile profile(__func__, k, deadline_us);
+    for (int i = 0; i < request_n; ++i) {
+      scatter_request_t request(k, deadline, random);
+      gather_t gather{k};
+      std::vector<coroutine> children(k);
+      auto request_before = clk::now();
+      for (int j = 0; j < k; ++j) {
+        children[j] = [](timer_loop_t &loop, gather_t &gather, us latency) -> coroutine {
+          TRACE("scatter_sub_task", start, &gather);
+          co_await sleep_for_t{loop, latency};
+          TRACE("scatter_sub_task", finish, &gather);
+          gather.done();
+        }(loop, gather, request.latencies[j]);
+      }
+      auto parent = [](std::vector<coroutine> &children, gather_t &gather, timer_loop_t &loop,
+                       time_point_t deadline) -> coroutine {
+        co_await when_all_until_t{&children, &gather, &loop, deadline};
+      }(children, gather, loop, request_before + deadline);
+      parent.resume();
+      TRACE(__func__, block, &gather);
+      loop.run_until(gather.gathered);
+      auto request_after = clk::now();
+      TRACE(__func__, wake, &gather);
+      for (auto &tid : children) {
+        if (!tid.done()) {
+          tid.destroy();
+          tid = {};
+          ++request.cancelled_n;
+        }
+      }
+      loop.clear();
+      auto cancel_after = clk::now();
+      stat.round(request_after - request_before, gather.missed, cancel_after - request_after,
+                 request.cancelled_n);
+
+      for (auto &tid : children) {
+        if (tid) {
+          tid.destroy();
+        }
+      }
+      parent.destroy();
+    }
+    profile.stop();
+    stat.print(deadline);
+  }
+}
+
+// inline tests: the whole coroutine is visible to the compiler, only resume() stays an
+// indirect call into the frame
+struct cpp20co_backend_t {
+  using handle_t = coroutine;
+  static const char *name() { return "cpp20co"; }
+
+  // created suspended, join resumes and destroys it, as in create_join_test
+  template <typename Body> static coroutine spawn(Body body, int *data) {
+    return [](Body body, int *data) -> coroutine {
+      body(data);
+      co_return;
+    }(body, data);
+  }
+
+  static void join(coroutine &co) {
+    co.resume();
+    co.destroy();
+  }
+
+  template <typename Body> static ns switch_loop(Body body, int *data, uint64_t switch_n) {
+    auto co = [](Body body, int *data) -> coroutine {
+      for (;;) {
+        body(data);
+        co_await std::suspend_always{};
+      }
+    }(body, data);
+    auto switch_before = clk::now();
+    while (switch_n--) {
+      co.resume();
+    }
+    auto switch_duration = clk::now() - switch_before;
+    co.destroy();
+    return std::chrono::duration_cast<ns>(switch_duration);
+  }
+};
+
+static void cpp20co_inline_test(int coroutine_n, uint64_t switch_n) {
+  inline_tests<cpp20co_backend_t>(coroutine_n, switch_n);
+}
+
 Benchmark benchmark{
     cpp20co_create_join_test,  cpp20co_loop_test_1,       cpp20co_loop_test_2,
     cpp20co_ctx_switch_test_1, cpp20co_ctx_switch_test_2, cpp20co_long_callback_test,
+    cpp20co_pipeline_test,     cpp20co_stack_fault_test,  cpp20co_tls_test,
+    cpp20co_queue_test,        cpp20co_hybrid_test,       cpp20co_lifecycle_test,
+    cpp20co_teardown_test,     cpp20co_oversubscribe_test, cpp20co_join_test,
+    cpp20co_false_sharing_test, cpp20co_alloc_test, cpp20co_scatter_gather_test,
+    cpp20co_inline_test,
 };
\ No newline at end of file
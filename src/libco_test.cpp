@@ -1,4 +1,7 @@
+#include "alloc.h"
 #include "benchmark.h"
+#include "inline.h"
+#include "trace.h"
 #include <algorithm>
 #include <cassert>
 #include <fmt/core.h>
@@ -9,9 +12,11 @@
 static void libco_create_join_test(int coroutine_n) {
   // create coroutine_n coroutines
   std::vector<stCoRoutine_t *> coroutines(coroutine_n);
+  Profile profile(__func__, coroutine_n);
   auto create_before = clk::now();
   for (auto &tid : coroutines) {
     co_create(&tid, nullptr, Utils::f_null, nullptr);
+    TRACE(__func__, spawn, tid);
   }
   auto create_after = clk::now();
   auto create_duration = create_after - create_before;
@@ -22,28 +27,34 @@ static void libco_create_join_test(int coroutine_n) {
 
   auto resume_before = clk::now();
   for (auto &tid : coroutines) {
+    TRACE(__func__, start, tid);
     co_resume(tid);
+    TRACE(__func__, finish, tid);
   }
   auto resume_after = clk::now();
+  profile.stop();
   auto resume_duration = resume_after - resume_before;
   auto resume_us = std::chrono::duration_cast<us>(resume_duration).count();
   auto resume_ns = std::chrono::duration_cast<ns>(resume_duration).count();
   fmt::print("resume {} coroutines, cost {} us, {} ns\n", coroutine_n, resume_us,
              resume_ns);
 
-  // TODO: need relaese
+  for (auto tid : coroutines) {
+    co_release(tid);
+  }
 }
 
 static void libco_loop_test_1(int coroutine_n) {
-  std::vector<int> datas(coroutine_n, 10);
-  std::vector<int> results(coroutine_n);
-  std::transform(datas.begin(), datas.end(), results.begin(), Utils::op_mul_1<int>);
+  loop_layout_t datas(coroutine_n);
+  std::vector<int> results(coroutine_n, 10);
+  std::transform(results.begin(), results.end(), results.begin(), Utils::op_mul_1<int>);
 
   std::vector<stCoRoutine_t *> coroutines(coroutine_n);
 
+  Profile profile(__func__, coroutine_n);
   auto run_before = clk::now();
   for (int i = 0; i < coroutine_n; ++i) {
-    co_create(&coroutines[i], nullptr, Utils::f_mul_1, &datas[i]);
+    co_create(&coroutines[i], nullptr, datas.task(), datas.data(i));
     // co_resume(coroutines[i]);
 
     // @notes:
@@ -53,17 +64,22 @@ static void libco_loop_test_1(int coroutine_n) {
   for (auto &tid : coroutines) {
     co_resume(tid);
   }
+  datas.merge();
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
   fmt::print(
-      "launch {} coroutines to multiply a vector to a scalar, end-to-end cost {} us\n",
-      coroutine_n, run_us);
+      "launch {} coroutines to multiply a vector to a scalar, {} layout, end-to-end cost {} "
+      "us\n",
+      coroutine_n, datas.layout, run_us);
 
-  assert(datas == results);
+  assert(datas.values() == results);
 
-  // TODO: need release
+  for (auto tid : coroutines) {
+    co_release(tid);
+  }
 }
 
 static void libco_loop_test_2(int coroutine_n) {
@@ -74,6 +90,7 @@ static void libco_loop_test_2(int coroutine_n) {
 
   std::vector<stCoRoutine_t *> coroutines(coroutine_n);
 
+  Profile profile(__func__, coroutine_n);
   auto run_before = clk::now();
   for (int i = 0; i < coroutine_n; ++i) {
     co_create(&coroutines[i], nullptr, Utils::f_mul_1M, &datas[i]);
@@ -87,6 +104,7 @@ static void libco_loop_test_2(int coroutine_n) {
     co_resume(tid);
   }
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
@@ -96,13 +114,20 @@ static void libco_loop_test_2(int coroutine_n) {
 
   assert(datas == results);
 
+  for (auto tid : coroutines) {
+    co_release(tid);
+  }
 }
 
 static void *f_switch(void *switch_n) {
   auto switch_left = (uint64_t)switch_n;
+  TRACE("ctx_switch", start, 0);
   while (switch_left--) {
+    TRACE("ctx_switch", yield, 0);
     co_yield_ct();
+    TRACE("ctx_switch", resume, 0);
   }
+  TRACE("ctx_switch", finish, 0);
   return nullptr;
 }
 
@@ -111,6 +136,7 @@ static void libco_ctx_switch_test_1(uint64_t switch_n) {
   stCoRoutine_t *co;
   co_create(&co, nullptr, f_switch, (void *)switch_n);
 
+  Profile profile(__func__, switch_n);
   auto switch_before = clk::now();
 
   auto switch_left = switch_n;
@@ -119,6 +145,7 @@ static void libco_ctx_switch_test_1(uint64_t switch_n) {
   }
 
   auto switch_after = clk::now();
+  profile.stop();
   auto switch_duration = switch_after - switch_before;
   auto switch_us = std::chrono::duration_cast<us>(switch_duration).count();
 
@@ -136,7 +163,188 @@ static void libco_long_callback_test(int coroutine_n) {
   // TODO
 }
 
+static void libco_pipeline_test(int stage_n, int item_n, int batch_n) {
+  fmt::print("Not Implemented.\n");
+}
+
+static void libco_stack_fault_test(int coroutine_n, bool prefault) {
+  if (prefault) {
+    fmt::print("pre-faulted stack pool is not available for libco, using library "
+               "stacks.\n");
+  }
+  // default stack size of co_create()
+  std::vector<stack_probe_t> probes(coroutine_n, stack_probe_t{128 * 1024, 0});
+
+  std::vector<stCoRoutine_t *> coroutines(coroutine_n);
+  Profile profile(__func__, coroutine_n, prefault);
+  auto create_faults = Utils::minor_faults();
+  auto create_before = clk::now();
+  for (int i = 0; i < coroutine_n; ++i) {
+    co_create(&coroutines[i], nullptr, Utils::f_touch_stack, &probes[i]);
+  }
+  auto create_after = clk::now();
+  create_faults = Utils::minor_faults() - create_faults;
+  auto create_us = std::chrono::duration_cast<us>(create_after - create_before).count();
+
+  auto resume_faults = Utils::minor_faults();
+  auto resume_before = clk::now();
+  for (auto &tid : coroutines) {
+    co_resume(tid);
+  }
+  auto resume_after = clk::now();
+  profile.stop();
+  resume_faults = Utils::minor_faults() - resume_faults;
+  auto resume_us = std::chrono::duration_cast<us>(resume_after - resume_before).count();
+
+  fmt::print("create {} coroutines, cost {} us, {} minor faults\n", coroutine_n, create_us,
+             create_faults);
+  fmt::print("resume {} coroutines, cost {} us, {} minor faults\n", coroutine_n, resume_us,
+             resume_faults);
+  fmt::print("{:.1f} minor faults per coroutine, {} stack pages resident per coroutine\n",
+             double(create_faults + resume_faults) / coroutine_n,
+             Utils::avg_stack_pages(probes));
+
+  for (auto tid : coroutines) {
+    co_release(tid);
+  }
+}
+
+static void libco_tls_test(int coroutine_n, int migrate_n, uint64_t access_n) {
+  fmt::print("Not Implemented.\n");
+}
+
+static void libco_queue_test(int producer_n, int consumer_n, uint64_t item_n, int batch_n) {
+  fmt::print("Not Implemented, the queue tests run in benchmark_pthread.\n");
+}
+
+static void libco_hybrid_test(int thread_n, uint64_t switch_n) {
+  fmt::print("Not Implemented, cpp20co runs hybrid tests on the in-repo thread pool.\n");
+}
+
+static void libco_lifecycle_test(int worker_n) {
+  fmt::print("Not Implemented, libco has no scheduler to start or stop.\n");
+}
+
+static void libco_teardown_test(int coroutine_n, int repeat_n) {
+  std::vector<stCoRoutine_t *> coroutines(coroutine_n);
+  reclaim_stat_t stat(repeat_n);
+  for (int round = 0; round < repeat_n; ++round) {
+    for (auto &tid : coroutines) {
+      co_create(&tid, nullptr, Utils::f_null, nullptr);
+      co_resume(tid);
+    }
+
+    Profile profile(__func__, coroutine_n, round);
+    auto destroy_before = clk::now();
+    for (auto tid : coroutines) {
+      co_release(tid);
+    }
+    auto destroy_after = clk::now();
+    profile.stop();
+    stat.round(coroutine_n, destroy_after - destroy_before);
+  }
+  stat.print();
+}
+
+static void libco_oversubscribe_test(int task_n, uint64_t work_n) {
+  fmt::print("Not Implemented, libco runs on one thread.\n");
+}
+
+static void libco_join_test(int max_n) {
+  fmt::print("Not Implemented, co_resume returns when the coroutine yields or ends.\n");
+}
+
+static void libco_false_sharing_test(int coroutine_n, uint64_t write_n) {
+  fmt::print("Not Implemented, libco runs on one thread.\n");
+}
+
+// allocation tests: the coroutines are resumed round robin, on one thread, so there are
+// no cross-thread frees
+static void f_yield() { co_yield_ct(); }
+
+static void libco_alloc_test(int coroutine_n, uint64_t alloc_n) {
+  alloc_run_t run(coroutine_n, alloc_n);
+  std::vector<args_alloc_t> args(coroutine_n);
+  std::vector<stCoRoutine_t *> coroutines(coroutine_n);
+  for (int i = 0; i < coroutine_n; ++i) {
+    args[i] = {&run.tasks[i], &run.exchange};
+    co_create(&coroutines[i], nullptr, f_alloc<f_yield>, &args[i]);
+  }
+
+  Profile profile(__func__, coroutine_n, alloc_n);
+  run.start();
+  for (bool running = true; running;) {
+    running = false;
+    for (int i = 0; i < coroutine_n; ++i) {
+      // a task with nothing left to allocate has returned
+      if (run.tasks[i].alloc_left > 0) {
+        co_resume(coroutines[i]);
+        running = true;
+      }
+    }
+  }
+  run.stop();
+  profile.stop();
+  run.print(coroutine_n);
+
+  for (auto tid : coroutines) {
+    co_release(tid);
+  }
+}
+
+static void libco_scatter_gather_test(int request_n, int fanout_k, uint64_t deadline_us) {
+  fmt::print("Not Implemented, libco only has timeouts in co_poll of its event loop.\n");
+}
+
+// inline tests: spawn creates a coroutine, join resumes and releases it, as in
+// create_join_test
+struct libco_backend_t {
+  using handle_t = stCoRoutine_t *;
+  static const char *name() { return "libco"; }
+
+  template <typename Body> static stCoRoutine_t *spawn(Body, int *data) {
+    stCoRoutine_t *co;
+    co_create(&co, nullptr, f_body<Body>, data);
+    return co;
+  }
+
+  static void join(stCoRoutine_t *&co) {
+    co_resume(co);
+    co_release(co);
+  }
+
+  template <typename Body> static void *f_switch(void *data) {
+    Body body;
+    for (;;) {
+      body(static_cast<int *>(data));
+      co_yield_ct();
+    }
+    return nullptr;
+  }
+
+  template <typename Body> static ns switch_loop(Body, int *data, uint64_t switch_n) {
+    stCoRoutine_t *co;
+    co_create(&co, nullptr, f_switch<Body>, data);
+    auto switch_before = clk::now();
+    while (switch_n--) {
+      co_resume(co);
+    }
+    auto switch_duration = clk::now() - switch_before;
+    co_release(co);
+    return std::chrono::duration_cast<ns>(switch_duration);
+  }
+};
+
+static void libco_inline_test(int coroutine_n, uint64_t switch_n) {
+  inline_tests<libco_backend_t>(coroutine_n, switch_n);
+}
+
 Benchmark benchmark{
     libco_create_join_test,  libco_loop_test_1,       libco_loop_test_2,
     libco_ctx_switch_test_1, libco_ctx_switch_test_2, libco_long_callback_test,
+    libco_pipeline_test,     libco_stack_fault_test,  libco_tls_test,
+    libco_queue_test,        libco_hybrid_test,       libco_lifecycle_test,
+    libco_teardown_test,     libco_oversubscribe_test, libco_join_test,
+    libco_false_sharing_test, libco_alloc_test, libco_scatter_gather_test,
+    libco_inline_test,
 };
\ No newline at end of file
@@ -1,17 +1,66 @@
+#include "alloc.h"
 #include "benchmark.h"
+#include "hybrid.h"
+#include "inline.h"
+#include "scatter.h"
+#include "trace.h"
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <fmt/core.h>
 #include <iostream>
 #include <libgo/coroutine.h>
+#include <random>
+#include <vector>
+
+// A scheduler owned by one test, so that several tests can run in one process. It is
+// started, and warmed up by a first coroutine, before the measured region and stopped
+// after it. Startup-to-first-coroutine and shutdown times are kept for the lifecycle
+// test.
+struct libgo_scheduler_t {
+  explicit libgo_scheduler_t(int worker_n) : scheduler(co::Scheduler::Create()) {
+    auto start_before = clk::now();
+    thread = std::thread([this, worker_n]() { scheduler->Start(worker_n); });
+    co_chan<int> ch(1);
+    go co_scheduler(scheduler)[ch]() { ch << 1; };
+    int signal;
+    ch >> signal;
+    startup = std::chrono::duration_cast<ns>(clk::now() - start_before);
+  }
+
+  ~libgo_scheduler_t() { stop(); }
+
+  void stop() {
+    if (!thread.joinable()) {
+      return;
+    }
+    auto stop_before = clk::now();
+    scheduler->Stop();
+    thread.join();
+    shutdown = std::chrono::duration_cast<ns>(clk::now() - stop_before);
+    // Create() hands over ownership, the workers are gone once Start() has returned
+    delete scheduler;
+    scheduler = nullptr;
+  }
+
+  co::Scheduler *scheduler;
+  std::thread thread;
+  ns startup{0};
+  ns shutdown{0};
+};
 
 static void libgo_create_join_test(int coroutine_n) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  Profile profile(__func__, coroutine_n);
   auto create_before = clk::now();
 
   co_chan<int> ch;
   for (int i = 0; i < coroutine_n; ++i) {
-    go[ch] {
+    TRACE(__func__, spawn, i);
+    go co_scheduler(sched.scheduler)[ch, i] {
+      TRACE("libgo_create_join_test", start, i);
       Utils::f_null(nullptr);
+      TRACE("libgo_create_join_test", finish, i);
       ch << 1;
     };
   }
@@ -22,9 +71,7 @@ static void libgo_create_join_test(int coroutine_n) {
 
   fmt::print("create {} threads, cost {} us\n", coroutine_n, create_us);
 
-  // ignore new schedule thread's overhead
-  std::thread([]() { co_sched.Start(std::thread::hardware_concurrency()); }).detach();
-
+  TRACE(__func__, block, 0);
   auto ch_before = clk::now();
 
   int signal;
@@ -33,6 +80,8 @@ static void libgo_create_join_test(int coroutine_n) {
   }
 
   auto ch_after = clk::now();
+  TRACE(__func__, wake, 0);
+  profile.stop();
   auto ch_duration = ch_after - ch_before;
   auto ch_us = std::chrono::duration_cast<us>(ch_duration).count();
 
@@ -42,35 +91,39 @@ static void libgo_create_join_test(int coroutine_n) {
 static void libgo_loop_test_1(int coroutine_n) {
   // For each element in data vector
   // create a thread to do multiply
-  std::vector<int> datas(coroutine_n, 10);
-  std::vector<int> results(coroutine_n);
-  std::transform(datas.begin(), datas.end(), results.begin(), Utils::op_mul_1<int>);
+  loop_layout_t datas(coroutine_n);
+  std::vector<int> results(coroutine_n, 10);
+  std::transform(results.begin(), results.end(), results.begin(), Utils::op_mul_1<int>);
 
+  libgo_scheduler_t sched(1);
+  // the scheduler is already running, so timing starts before the first go
+  Profile profile(__func__, coroutine_n);
+  auto run_before = clk::now();
   co_chan<int> ch;
   for (int i = 0; i < coroutine_n; ++i) {
-    go[=, &datas]() {
-      Utils::f_mul_1(&datas[i]);
+    go co_scheduler(sched.scheduler)[=, &datas]() {
+      datas.task()(datas.data(i));
       ch << 1;
     };
   };
 
-  std::thread([]() { co_sched.Start(/*default = (1, 0)*/); }).detach();
-  auto run_before = clk::now();
-
   int join;
   for (int i = 0; i < coroutine_n; i++) {
     ch >> join;
   }
 
+  datas.merge();
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
   fmt::print(
-      "launch {} threads to multiply a vector to a scalar, end-to-end cost {} us\n",
-      coroutine_n, run_us);
+      "launch {} threads to multiply a vector to a scalar, {} layout, end-to-end cost {} "
+      "us\n",
+      coroutine_n, datas.layout, run_us);
 
-  assert(datas == results);
+  assert(datas.values() == results);
 }
 
 static void libgo_loop_test_2(int coroutine_n) { // For each element in data vector
@@ -80,29 +133,31 @@ static void libgo_loop_test_2(int coroutine_n) { // For each element in data vec
   std::transform(datas.begin(), datas.end(), results.begin(),
                  Utils::op_mul_1000000<int>);
 
+  libgo_scheduler_t sched(Utils::cpu_count());
+  // the scheduler is already running, so timing starts before the first go
+  Profile profile(__func__, coroutine_n);
+  auto run_before = clk::now();
   co_chan<int> ch;
   for (int i = 0; i < coroutine_n; ++i) {
-    go[=, &datas]() {
+    go co_scheduler(sched.scheduler)[=, &datas]() {
       Utils::f_mul_1M(&datas[i]);
       ch << 1;
     };
   };
 
-  std::thread([]() { co_sched.Start(std::thread::hardware_concurrency()); }).detach();
-  auto run_before = clk::now();
-
   int join;
   for (int i = 0; i < coroutine_n; ++i) {
     ch >> join;
   }
 
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
   fmt::print("launch {} coroutine on {} threads to multiply a vector to a scalar, "
              "end-to-end cost {} us\n",
-             coroutine_n, std::thread::hardware_concurrency(), run_us);
+             coroutine_n, Utils::cpu_count(), run_us);
 
   assert(datas == results);
 }
@@ -111,23 +166,28 @@ static void libgo_ctx_switch_test_1(uint64_t switch_n) {
   auto switch_before = new time_point_t{};
   auto switch_after = new time_point_t{};
 
+  libgo_scheduler_t sched(1);
+  Profile profile(__func__, switch_n);
   co_chan<int> ch;
-  go[=]() {
+  go co_scheduler(sched.scheduler)[=]() {
     auto switch_left = switch_n;
 
+    TRACE("ctx_switch", start, 0);
     *switch_before = clk::now();
     while (switch_left--) {
+      TRACE("ctx_switch", yield, 0);
       co_yield;
+      TRACE("ctx_switch", resume, 0);
     }
     *switch_after = clk::now();
+    TRACE("ctx_switch", finish, 0);
 
     ch << 1; // join
   };
 
-  std::thread([]() { co_sched.Start(1); }).detach();
-
   int join;
   ch >> join;
+  profile.stop();
 
   auto switch_duration = *switch_after - *switch_before;
   auto switch_us = std::chrono::duration_cast<us>(switch_duration).count();
@@ -144,27 +204,32 @@ static void libgo_ctx_switch_test_2(int coroutine_n, uint64_t switch_n) {
   auto switch_befores = new time_point_t[coroutine_n];
   auto switch_afters = new time_point_t[coroutine_n];
 
+  libgo_scheduler_t sched(Utils::cpu_count());
+  Profile profile(__func__, coroutine_n, switch_n);
   co_chan<int> ch;
   for (int i = 0; i < coroutine_n; ++i) {
-    go[=]() {
+    go co_scheduler(sched.scheduler)[=]() {
       auto switch_left = switch_n;
 
+      TRACE("ctx_switch", start, i);
       switch_befores[i] = clk::now();
       while (switch_left--) {
+        TRACE("ctx_switch", yield, i);
         co_yield;
+        TRACE("ctx_switch", resume, i);
       }
       switch_afters[i] = clk::now();
+      TRACE("ctx_switch", finish, i);
 
       ch << 1; // join
     };
   }
 
-  std::thread([]() { co_sched.Start(std::thread::hardware_concurrency()); }).detach();
-
   int join;
   for (int i = 0; i < coroutine_n; ++i) {
     ch >> join;
   }
+  profile.stop();
 
   auto switch_before = *std::min_element(switch_befores, switch_befores + coroutine_n);
   auto switch_after = *std::max_element(switch_afters, switch_afters + coroutine_n);
@@ -193,13 +258,19 @@ static void libgo_start_urgent_test(int coroutine_n) {
   auto urgent_start = new time_point_t{};
   auto urgent_after = new time_point_t{};
 
+  libgo_scheduler_t sched(2);
+  auto scheduler = sched.scheduler;
+  Profile profile(__func__, coroutine_n);
   co_chan<int> ch;
-  go[=]() {
+  go co_scheduler(scheduler)[=]() {
     // fmt::print("worker tid: {}\n", pthread_self());
+    TRACE("worker", start, 0);
     *urgent_before = clk::now();
 
-    go[=]() {
+    TRACE("urgent", spawn, 1);
+    go co_scheduler(scheduler)[=]() {
       *urgent_start = clk::now();
+      TRACE("urgent", start, 1);
       // fmt::print("urgent tid: {}\n", pthread_self());
       // 1. Block the thread. Enable this only when libco compiled as no-hook
       // sleep(2);
@@ -208,20 +279,23 @@ static void libgo_start_urgent_test(int coroutine_n) {
       Utils::f_mul_1M(&i);
       fmt::print("{}\n", i);
 
+      TRACE("urgent", finish, 1);
       ch << 1;
     };
+    TRACE("worker", yield, 0);
     co_yield;
+    TRACE("worker", resume, 0);
 
     *urgent_after = clk::now();
     // fmt::print("worker tid: {}\n", pthread_self());
 
+    TRACE("worker", finish, 0);
     ch << 1;
   };
 
-  std::thread([]() { co_sched.Start(2); }).detach();
-
   int join;
   ch >> join, ch >> join;
+  profile.stop();
 
   auto urgent_duration = *urgent_start - *urgent_before;
   auto worker_duration = *urgent_after - *urgent_before;
@@ -235,7 +309,570 @@ static void libgo_start_urgent_test(int coroutine_n) {
   delete urgent_after;
 }
 
+static void libgo_pipeline_test(int stage_n, int item_n, int batch_n) {
+  // source -> stage_n transform stages -> sink, stages are coroutines connected by
+  // channels, the sink is the calling thread.
+  batch_n = std::max(batch_n, 1); // a batch of 0 would never move an item
+  const int batch_total = (item_n + batch_n - 1) / batch_n;
+  auto chs = std::vector<co_chan<batch_t>>();
+  for (int i = 0; i < stage_n + 1; ++i) {
+    chs.emplace_back(64);
+  }
+
+  pipeline_sink_t sink(stage_n, item_n);
+
+  libgo_scheduler_t sched(Utils::cpu_count());
+  Profile profile(__func__, stage_n, item_n, batch_n);
+  auto run_before = clk::now();
+
+  go co_scheduler(sched.scheduler)[=]() {
+    uint64_t item_next = 0;
+    for (int item_left = item_n; item_left > 0;) {
+      auto batch = batch_t(std::min(item_left, batch_n));
+      auto born = clk::now();
+      for (auto &item : batch) {
+        item = {item_next, item_next, born};
+        ++item_next;
+      }
+      item_left -= batch.size();
+      chs[0] << std::move(batch);
+    }
+  };
+  for (int i = 0; i < stage_n; ++i) {
+    go co_scheduler(sched.scheduler)[=]() {
+      batch_t batch;
+      for (int j = 0; j < batch_total; ++j) {
+        TRACE("pipeline_stage", block, i);
+        chs[i] >> batch;
+        TRACE("pipeline_stage", wake, i);
+        for (auto &item : batch) {
+          item = Utils::op_stage(item);
+        }
+        chs[i + 1] << std::move(batch);
+      }
+    };
+  }
+
+  batch_t batch;
+  for (int j = 0; j < batch_total; ++j) {
+    chs[stage_n] >> batch;
+    auto died = clk::now();
+    for (auto &item : batch) {
+      sink.take(item, died);
+    }
+  }
+
+  auto run_after = clk::now();
+  profile.stop();
+  auto run_duration = run_after - run_before;
+  auto run_us = std::chrono::duration_cast<us>(run_duration).count();
+
+  fmt::print("pass {} items through {} stages of coroutines in batches of {}, cost {} us, "
+             "{:.0f} items/s\n",
+             item_n, stage_n, batch_n, run_us, item_n * 1000000.0 / std::max<long>(run_us, 1));
+  sink.print(item_n);
+}
+
+static void libgo_stack_fault_test(int coroutine_n, bool prefault) {
+  if (prefault) {
+    fmt::print("pre-faulted stack pool is not available for libgo, using library "
+               "stacks.\n");
+  }
+  // co_opt.stack_size
+  std::vector<stack_probe_t> probes(coroutine_n, stack_probe_t{1024 * 1024, 0});
+
+  libgo_scheduler_t sched(Utils::cpu_count());
+  Profile profile(__func__, coroutine_n, prefault);
+  auto create_faults = Utils::minor_faults();
+  auto create_before = clk::now();
+
+  co_chan<int> ch;
+  for (int i = 0; i < coroutine_n; ++i) {
+    go co_scheduler(sched.scheduler)[=, &probes]() {
+      Utils::f_touch_stack(&probes[i]);
+      ch << 1;
+    };
+  }
+
+  auto create_after = clk::now();
+  create_faults = Utils::minor_faults() - create_faults;
+  auto create_us = std::chrono::duration_cast<us>(create_after - create_before).count();
+
+  auto ch_faults = Utils::minor_faults();
+  TRACE(__func__, block, 0);
+  auto ch_before = clk::now();
+
+  int signal;
+  for (int i = 0; i < coroutine_n; ++i) {
+    ch >> signal;
+  }
+
+  auto ch_after = clk::now();
+  TRACE(__func__, wake, 0);
+  profile.stop();
+  ch_faults = Utils::minor_faults() - ch_faults;
+  auto ch_us = std::chrono::duration_cast<us>(ch_after - ch_before).count();
+
+  fmt::print("create {} coroutines, cost {} us, {} minor faults\n", coroutine_n, create_us,
+             create_faults);
+  fmt::print("receive {} signals from channel, cost {} us, {} minor faults\n", coroutine_n,
+             ch_us, ch_faults);
+  fmt::print("{:.1f} minor faults per coroutine, {} stack pages resident per coroutine\n",
+             double(create_faults + ch_faults) / coroutine_n, Utils::avg_stack_pages(probes));
+}
+
+// tls tests
+co_cls_declare(uint64_t, libgo_cls_slot);
+co_cls_define(uint64_t, libgo_cls_slot, 0);
+
+struct libgo_cls_storage_t {
+  void set(uint64_t value) { libgo_cls_slot() = value; }
+  uint64_t get() { return libgo_cls_slot(); }
+};
+
+static void libgo_tls_test(int coroutine_n, int migrate_n, uint64_t access_n) {
+  // Coroutines yield between setting and getting a value while a holder blocks their
+  // worker, so that they are stolen by another worker. thread_local and
+  // pthread_getspecific then see the value that another coroutine set on the new worker.
+  // A go from a coroutine queues on its own worker, ahead of the yielding coroutine; the
+  // dispatcher moves the coroutine off the held worker, at least two workers are started
+  // so that there is one to move it to.
+  auto thread_local_stats = std::vector<tls_stat_t>(coroutine_n);
+  auto pthread_specific_stats = std::vector<tls_stat_t>(coroutine_n);
+  auto libgo_cls_stats = std::vector<tls_stat_t>(coroutine_n);
+  auto migrates = std::vector<tls_migrate_t>(coroutine_n);
+
+  libgo_scheduler_t sched(std::max(Utils::cpu_count(), 2));
+  Profile profile(__func__, coroutine_n, migrate_n, access_n);
+  co_chan<int> ch;
+  for (int i = 0; i < coroutine_n; ++i) {
+    go co_scheduler(sched.scheduler)[=, &thread_local_stats, &pthread_specific_stats,
+                                     &libgo_cls_stats, &migrates, &sched]() {
+      auto migrate = &migrates[i];
+      auto yield = [migrate, &sched]() {
+        co_chan<int> held(1);
+        migrate->resumed.store(false, std::memory_order_release);
+        go co_scheduler(sched.scheduler)[migrate, held] {
+          migrate->hold(ms(200));
+          held << 1;
+        };
+        co_yield;
+        migrate->resumed.store(true, std::memory_order_release);
+        int signal;
+        held >> signal;
+      };
+      uint64_t value = i + 1;
+      for (int j = 0; j < migrate_n; ++j) {
+        thread_local_stats[i].round(thread_local_storage_t{}, value, access_n, yield);
+        pthread_specific_stats[i].round(pthread_specific_storage_t{}, value, access_n, yield);
+        libgo_cls_stats[i].round(libgo_cls_storage_t{}, value, access_n, yield);
+      }
+      ch << 1;
+    };
+  }
+
+  int join;
+  for (int i = 0; i < coroutine_n; ++i) {
+    ch >> join;
+  }
+  profile.stop();
+
+  tls_stat_t thread_local_stat, pthread_specific_stat, libgo_cls_stat;
+  for (int i = 0; i < coroutine_n; ++i) {
+    thread_local_stat.merge(thread_local_stats[i]);
+    pthread_specific_stat.merge(pthread_specific_stats[i]);
+    libgo_cls_stat.merge(libgo_cls_stats[i]);
+  }
+  fmt::print("launch {} coroutines, yield {} times between {} accesses:\n", coroutine_n,
+             migrate_n, access_n);
+  thread_local_stat.print("thread_local");
+  pthread_specific_stat.print("pthread_getspecific");
+  libgo_cls_stat.print("co_cls");
+}
+
+static void libgo_queue_test(int producer_n, int consumer_n, uint64_t item_n, int batch_n) {
+  fmt::print("Not Implemented, the queue tests run in benchmark_pthread.\n");
+}
+
+// hybrid tests
+// Resume each coroutine in a new libgo task.
+struct libgo_executor_t {
+  void post(std::coroutine_handle<> handle) {
+    go co_scheduler(scheduler)[handle]() { handle.resume(); };
+  }
+  co::Scheduler *scheduler;
+};
+
+static void libgo_hybrid_test(int coroutine_n, uint64_t switch_n) {
+  // Native and hybrid tests share one scheduler, so the native tests are run inline
+  // rather than by the libgo_*_test functions, which start their own.
+  libgo_scheduler_t sched(Utils::cpu_count());
+
+  fmt::print("native libgo:\n");
+  {
+    std::latch done(coroutine_n);
+    auto create_before = clk::now();
+    for (int i = 0; i < coroutine_n; ++i) {
+      go co_scheduler(sched.scheduler)[&done]() {
+        Utils::f_null(nullptr);
+        done.count_down();
+      };
+    }
+    auto create_after = clk::now();
+    TRACE(__func__, block, 0);
+    done.wait();
+    auto join_after = clk::now();
+    TRACE(__func__, wake, 0);
+    fmt::print("create {} coroutines, cost {} us\n", coroutine_n,
+               std::chrono::duration_cast<us>(create_after - create_before).count());
+    fmt::print("join {} coroutines, cost {} us\n", coroutine_n,
+               std::chrono::duration_cast<us>(join_after - create_after).count());
+  }
+  {
+    std::vector<int> datas(coroutine_n, 10);
+    std::latch done(coroutine_n);
+    auto run_before = clk::now();
+    for (int i = 0; i < coroutine_n; ++i) {
+      go co_scheduler(sched.scheduler)[&done, &datas, i]() {
+        Utils::f_mul_1(&datas[i]);
+        done.count_down();
+      };
+    }
+    done.wait();
+    auto run_after = clk::now();
+    fmt::print("launch {} coroutines to multiply a vector to a scalar, end-to-end cost {} "
+               "us\n",
+               coroutine_n, std::chrono::duration_cast<us>(run_after - run_before).count());
+  }
+  {
+    std::latch done(1);
+    auto switch_before = clk::now();
+    go co_scheduler(sched.scheduler)[&done, switch_n]() {
+      auto switch_left = switch_n;
+      while (switch_left--) {
+        co_yield;
+      }
+      done.count_down();
+    };
+    done.wait();
+    auto switch_after = clk::now();
+    fmt::print("launch 1 coroutines, switch in-and-out {} times, cost {} us.\n", switch_n,
+               std::chrono::duration_cast<us>(switch_after - switch_before).count());
+  }
+  {
+    std::latch parked(coroutine_n);
+    co_chan<int> release;
+    auto rss_before = Utils::rss_kb();
+    for (int i = 0; i < coroutine_n; ++i) {
+      go co_scheduler(sched.scheduler)[&parked, release]() {
+        int signal;
+        parked.count_down();
+        release >> signal;
+      };
+    }
+    parked.wait();
+    auto rss_after = Utils::rss_kb();
+    for (int i = 0; i < coroutine_n; ++i) {
+      release << 1;
+    }
+    fmt::print("{} blocked coroutines hold {} KB\n", coroutine_n, rss_after - rss_before);
+  }
+
+  fmt::print("cpp20 coroutines on libgo:\n");
+  libgo_executor_t executor{sched.scheduler};
+  hybrid_tests(executor, "libgo", coroutine_n, switch_n);
+}
+
+// Every round creates and stops a new scheduler.
+static void libgo_lifecycle_test(int worker_n) {
+  for (int round = 0; round < 3; ++round) {
+    Profile profile(__func__, worker_n, round);
+    libgo_scheduler_t sched(worker_n);
+    sched.stop();
+    profile.stop();
+    fmt::print("round {}: start a scheduler of {} threads, first coroutine after {} us, "
+               "stop cost {} us\n",
+               round, worker_n, std::chrono::duration_cast<us>(sched.startup).count(),
+               std::chrono::duration_cast<us>(sched.shutdown).count());
+  }
+}
+
+// libgo frees a finished coroutine itself, after it has signalled; the teardown is
+// timed from the last signal until the scheduler holds no task.
+static void libgo_teardown_test(int coroutine_n, int repeat_n) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  reclaim_stat_t stat(repeat_n);
+  for (int round = 0; round < repeat_n; ++round) {
+    co_chan<int> ch(coroutine_n);
+    for (int i = 0; i < coroutine_n; ++i) {
+      go co_scheduler(sched.scheduler)[ch] {
+        Utils::f_null(nullptr);
+        ch << 1;
+      };
+    }
+    int signal;
+    for (int i = 0; i < coroutine_n; ++i) {
+      ch >> signal;
+    }
+
+    Profile profile(__func__, coroutine_n, round);
+    auto destroy_before = clk::now();
+    while (sched.scheduler->TaskCount() > 0) {
+      sched_yield();
+    }
+    auto destroy_after = clk::now();
+    profile.stop();
+    stat.round(coroutine_n, destroy_after - destroy_before);
+  }
+  stat.print();
+}
+
+static void libgo_oversubscribe_test(int task_n, uint64_t work_n) {
+  oversubscribe_sweep(task_n, work_n, [=](int worker_n, oversubscribe_run_t &point) {
+    libgo_scheduler_t sched(worker_n);
+    co_chan<int> ch(task_n);
+    Profile profile("libgo_oversubscribe_test", task_n, worker_n);
+    point.start();
+    for (int i = 0; i < task_n; ++i) {
+      auto task = point.submit(i);
+      go co_scheduler(sched.scheduler)[ch, task] {
+        Utils::f_spin(task);
+        ch << 1;
+      };
+    }
+    int signal;
+    for (int i = 0; i < task_n; ++i) {
+      ch >> signal;
+    }
+    point.stop();
+    profile.stop();
+    return true;
+  });
+}
+
+// join tests
+// A WaitGroup in the style of Go's: the last done() wakes the waiter through a channel,
+// so the join is one receive instead of one per coroutine.
+struct libgo_wait_group_t {
+  explicit libgo_wait_group_t(int count) : count(count), ch(1) {}
+
+  void done() {
+    if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      ch << 1;
+    }
+  }
+
+  void wait() {
+    int signal;
+    ch >> signal;
+  }
+
+  std::atomic<int> count;
+  co_chan<int> ch;
+};
+
+static void libgo_join_test(int max_n) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  for (auto coroutine_n : Utils::join_sizes(max_n)) {
+    {
+      co_chan<int> ch(coroutine_n);
+      Profile profile(__func__, "co_chan", coroutine_n);
+      auto launch_before = clk::now();
+      for (int i = 0; i < coroutine_n; ++i) {
+        go co_scheduler(sched.scheduler)[ch] {
+          Utils::f_null(nullptr);
+          ch << 1;
+        };
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      int signal;
+      for (int i = 0; i < coroutine_n; ++i) {
+        ch >> signal;
+      }
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("co_chan", coroutine_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+    {
+      libgo_wait_group_t wait_group(coroutine_n);
+      Profile profile(__func__, "wait_group", coroutine_n);
+      auto launch_before = clk::now();
+      for (int i = 0; i < coroutine_n; ++i) {
+        go co_scheduler(sched.scheduler)[&wait_group] {
+          Utils::f_null(nullptr);
+          wait_group.done();
+        };
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      wait_group.wait();
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("wait_group", coroutine_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+  }
+}
+
+static void libgo_false_sharing_test(int coroutine_n, uint64_t write_n) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  false_sharing_sweep(__func__, coroutine_n, write_n, [&](std::vector<sharing_args_t> &args) {
+    co_chan<int> ch(coroutine_n);
+    for (auto &arg : args) {
+      auto sharing_args = &arg;
+      go co_scheduler(sched.scheduler)[ch, sharing_args] {
+        Utils::f_write(sharing_args);
+        ch << 1;
+      };
+    }
+    int signal;
+    for (int i = 0; i < coroutine_n; ++i) {
+      ch >> signal;
+    }
+  });
+}
+
+static void libgo_alloc_test(int coroutine_n, uint64_t alloc_n) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  alloc_run_t run(coroutine_n, alloc_n);
+  auto exchange = &run.exchange;
+  co_chan<int> ch(coroutine_n);
+
+  Profile profile(__func__, coroutine_n, alloc_n);
+  run.start();
+  for (auto &alloc_task : run.tasks) {
+    auto task = &alloc_task;
+    go co_scheduler(sched.scheduler)[ch, task, exchange] {
+      while (task->step(*exchange)) {
+        co_yield;
+      }
+      ch << 1;
+    };
+  }
+  int signal;
+  for (int i = 0; i < coroutine_n; ++i) {
+    ch >> signal;
+  }
+  run.stop();
+  profile.stop();
+  run.print(coroutine_n);
+}
+
+// scatter-gather tests: sub-tasks sleep in a timed pop of a cancel channel, a co_timer
+// puts -1 among the results at the deadline
+static void libgo_scatter_gather_test(int request_n, int fanout_k, uint64_t deadline_us) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  co_timer timer(us(10), sched.scheduler);
+  auto deadline = us(deadline_us);
+  for (auto k : scatter_stat_t::fanouts(fanout_k)) {
+    scatter_stat_t stat(k);
+    std::mt19937_64 random(k);
+    Profile profile(__func__, k, deadline_us);
+    for (int i = 0; i < request_n; ++i) {
+      scatter_request_t request(k, deadline, random);
+      // 1 from a cancelled sub-task, 0 from one in time, -1 from the deadline
+      co_chan<int> results(k + 1);
+      co_chan<int> cancel(k);
+      auto request_before = clk::now();
+      for (auto latency : request.latencies) {
+        TRACE(__func__, spawn, &request);
+        go co_scheduler(sched.scheduler)[results, cancel, latency, &request] {
+          TRACE("scatter_sub_task", start, &request);
+          int signal;
+          results << (cancel.TimedPop(signal, latency) ? 1 : 0);
+          TRACE("scatter_sub_task", finish, &request);
+        };
+      }
+      auto deadline_timer = timer.ExpireAt(deadline, [results] { results << -1; });
+
+      TRACE(__func__, block, &request);
+      int result, gathered_n = 0;
+      bool missed = false;
+      while (gathered_n < k && !missed) {
+        results >> result;
+        missed = result < 0;
+        gathered_n += !missed;
+      }
+      auto request_after = clk::now();
+      TRACE(__func__, wake, &request);
+      if (missed) {
+        for (int j = gathered_n; j < k; ++j) {
+          cancel << 1;
+        }
+        for (; gathered_n < k; ++gathered_n) {
+          results >> result;
+          request.cancelled_n += result;
+        }
+      } else {
+        // a deadline firing now puts its -1 into a channel nobody reads
+        deadline_timer.StopTimer();
+      }
+      auto cancel_after = clk::now();
+      stat.round(request_after - request_before, missed, cancel_after - request_after,
+                 request.cancelled_n);
+    }
+    profile.stop();
+    stat.print(deadline);
+  }
+}
+
+// inline tests: spawn is a go of a closure holding the Body, joined through a channel as
+// in create_join_test; libgo still runs the closure through its own std::function.
+struct libgo_backend_t {
+  using handle_t = co_chan<int>;
+  static const char *name() { return "libgo"; }
+
+  template <typename Body> static co_chan<int> spawn(Body body, int *data) {
+    co_chan<int> done(1);
+    go co_scheduler(scheduler)[body, data, done] {
+      body(data);
+      done << 1;
+    };
+    return done;
+  }
+
+  static void join(co_chan<int> &done) {
+    int signal;
+    done >> signal;
+  }
+
+  // one coroutine yielding in-and-out, as in ctx_switch_test_1
+  template <typename Body> static ns switch_loop(Body body, int *data, uint64_t switch_n) {
+    ns duration{0};
+    co_chan<int> done(1);
+    go co_scheduler(scheduler)[body, data, switch_n, done, &duration] {
+      auto switch_before = clk::now();
+      for (auto switch_left = switch_n; switch_left--;) {
+        body(data);
+        co_yield;
+      }
+      duration = std::chrono::duration_cast<ns>(clk::now() - switch_before);
+      done << 1;
+    };
+    join(done);
+    return duration;
+  }
+
+  static inline co::Scheduler *scheduler = nullptr;
+};
+
+static void libgo_inline_test(int coroutine_n, uint64_t switch_n) {
+  libgo_scheduler_t sched(Utils::cpu_count());
+  libgo_backend_t::scheduler = sched.scheduler;
+  inline_tests<libgo_backend_t>(coroutine_n, switch_n);
+  libgo_backend_t::scheduler = nullptr;
+}
+
 Benchmark benchmark{
     libgo_create_join_test,  libgo_loop_test_1,       libgo_loop_test_2,
     libgo_ctx_switch_test_1, libgo_ctx_switch_test_2, libgo_start_urgent_test,
+    libgo_pipeline_test,     libgo_stack_fault_test,  libgo_tls_test,
+    libgo_queue_test,        libgo_hybrid_test,       libgo_lifecycle_test,
+    libgo_teardown_test,     libgo_oversubscribe_test, libgo_join_test,
+    libgo_false_sharing_test, libgo_alloc_test, libgo_scatter_gather_test,
+    libgo_inline_test,
 };
\ No newline at end of file
@@ -1,19 +1,35 @@
+#include "alloc.h"
 #include "benchmark.h"
+#include "executor.h"
+#include "inline.h"
+#include "queue.h"
+#include "scatter.h"
+#include "trace.h"
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <fmt/core.h>
 #include <iostream>
+#include <mutex>
 #include <pthread.h>
+#include <random>
+#include <sched.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/mman.h>
 #include <vector>
 
 // pthread start
 static void pthread_create_join_test(int thread_n) {
   // Create thread_n threads
   std::vector<pthread_t> threads(thread_n);
+  Profile profile(__func__, thread_n);
   auto create_before = clk::now();
   for (auto &tid : threads) {
     pthread_create(&tid, nullptr, Utils::f_null, nullptr);
+    TRACE(__func__, spawn, &tid);
   }
   auto create_after = clk::now();
   auto create_duration = create_after - create_before;
@@ -22,39 +38,46 @@ static void pthread_create_join_test(int thread_n) {
   fmt::print("create {} threads, cost {} us\n", thread_n, create_us);
 
   // Join thread_n threads
+  TRACE(__func__, block, 0);
   auto join_before = clk::now();
   for (auto tid : threads) {
     pthread_join(tid, nullptr);
   }
   auto join_after = clk::now();
+  TRACE(__func__, wake, 0);
+  profile.stop();
   auto join_duration = join_after - join_before;
   auto join_us = std::chrono::duration_cast<us>(join_duration).count();
   fmt::print("join {} threads, cost {} us\n", thread_n, join_us);
 }
 
 static void pthread_loop_test_1(int thread_n) {
-  std::vector<int> datas(thread_n, 10);
-  std::vector<int> results(thread_n);
-  std::transform(datas.begin(), datas.end(), results.begin(), Utils::op_mul_1<int>);
+  loop_layout_t datas(thread_n);
+  std::vector<int> results(thread_n, 10);
+  std::transform(results.begin(), results.end(), results.begin(), Utils::op_mul_1<int>);
 
   std::vector<pthread_t> threads(thread_n);
 
+  Profile profile(__func__, thread_n);
   auto run_before = clk::now();
   for (int i = 0; i < thread_n; ++i) {
-    pthread_create(&threads[i], nullptr, Utils::f_mul_1, &datas[i]);
+    pthread_create(&threads[i], nullptr, datas.task(), datas.data(i));
   }
   for (auto tid : threads) {
     pthread_join(tid, nullptr);
   }
+  datas.merge();
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
   fmt::print(
-      "launch {} threads to multiply a vector to a scalar, end-to-end cost {} us\n",
-      thread_n, run_us);
+      "launch {} threads to multiply a vector to a scalar, {} layout, end-to-end cost {} "
+      "us\n",
+      thread_n, datas.layout, run_us);
 
-  assert(datas == results);
+  assert(datas.values() == results);
 }
 
 static void pthread_loop_test_2(int thread_n) {
@@ -65,6 +88,7 @@ static void pthread_loop_test_2(int thread_n) {
 
   std::vector<pthread_t> threads(thread_n);
 
+  Profile profile(__func__, thread_n);
   auto run_before = clk::now();
   for (int i = 0; i < thread_n; ++i) {
     pthread_create(&threads[i], nullptr, Utils::f_mul_1M, &datas[i]);
@@ -73,6 +97,7 @@ static void pthread_loop_test_2(int thread_n) {
     pthread_join(tid, nullptr);
   }
   auto run_after = clk::now();
+  profile.stop();
   auto run_duration = run_after - run_before;
   auto run_us = std::chrono::duration_cast<us>(run_duration).count();
 
@@ -98,11 +123,15 @@ static void *f_ctx_switch(void *args) {
   auto switch_befores = args_ctx->switch_befores;
   auto switch_afters = args_ctx->switch_afters;
 
+  TRACE("ctx_switch", start, thread_i);
   switch_befores[thread_i] = clk::now();
   while (switch_n--) {
+    TRACE("ctx_switch", yield, thread_i);
     pthread_yield();
+    TRACE("ctx_switch", resume, thread_i);
   }
   switch_afters[thread_i] = clk::now();
+  TRACE("ctx_switch", finish, thread_i);
 
   return nullptr;
 }
@@ -117,9 +146,11 @@ static void pthread_ctx_switch_test_1(uint64_t switch_n) {
   auto arg = new args_ctx_switch_t{0, switch_n, switch_before, switch_after};
 
   // threads
+  Profile profile(__func__, switch_n);
   auto tid = pthread_t{};
   pthread_create(&tid, nullptr, f_ctx_switch, arg);
   pthread_join(tid, nullptr);
+  profile.stop();
 
   auto switch_duration = *switch_after - *switch_before;
   auto switch_us = std::chrono::duration_cast<us>(switch_duration).count();
@@ -144,6 +175,7 @@ static void pthread_ctx_switch_test_2(int thread_n, uint64_t switch_n) {
   }
 
   // threads
+  Profile profile(__func__, thread_n, switch_n);
   auto threads = std::vector<pthread_t>(thread_n);
   for (int i = 0; i < thread_n; ++i) {
     pthread_create(&threads[i], nullptr, f_ctx_switch, &args[i]);
@@ -151,6 +183,7 @@ static void pthread_ctx_switch_test_2(int thread_n, uint64_t switch_n) {
   for (auto tid : threads) {
     pthread_join(tid, nullptr);
   }
+  profile.stop();
 
   auto switch_before = *std::min_element(switch_befores, switch_befores + thread_n);
   auto switch_after = *std::max_element(switch_afters, switch_afters + thread_n);
@@ -169,7 +202,726 @@ static void pthread_long_callback_test(int thread_n) {
   // TODO
 }
 
+// pipeline tests
+struct args_stage_t {
+  spsc_ring_t<pipeline_item_t> *in;  // nullptr for the source
+  spsc_ring_t<pipeline_item_t> *out; // nullptr for the sink
+  int item_n;
+  int batch_n;
+  pipeline_sink_t *sink;
+};
+
+static void *f_stage(void *args) {
+  auto args_stage = static_cast<args_stage_t *>(args);
+  auto batch = batch_t(args_stage->batch_n);
+  TRACE("pipeline_stage", start, args_stage);
+
+  int item_left = args_stage->item_n;
+  uint64_t item_next = 0;
+  while (item_left > 0) {
+    size_t n = 0;
+    if (args_stage->in == nullptr) {
+      n = std::min(item_left, args_stage->batch_n);
+      auto born = clk::now();
+      for (size_t i = 0; i < n; ++i) {
+        batch[i] = {item_next, item_next, born};
+        ++item_next;
+      }
+    } else {
+      while ((n = args_stage->in->pop_n(batch.data(), args_stage->batch_n)) == 0) {
+        sched_yield();
+      }
+    }
+    item_left -= n;
+
+    if (args_stage->out == nullptr) {
+      auto died = clk::now();
+      for (size_t i = 0; i < n; ++i) {
+        args_stage->sink->take(batch[i], died);
+      }
+      continue;
+    }
+    if (args_stage->in != nullptr) {
+      for (size_t i = 0; i < n; ++i) {
+        batch[i] = Utils::op_stage(batch[i]);
+      }
+    }
+    size_t pushed = 0;
+    while ((pushed += args_stage->out->push_n(batch.data() + pushed, n - pushed)) < n) {
+      sched_yield();
+    }
+  }
+  TRACE("pipeline_stage", finish, args_stage);
+  return nullptr;
+}
+
+static void pthread_pipeline_test(int stage_n, int item_n, int batch_n) {
+  // source -> stage_n transform stages -> sink, one thread each, connected by
+  // bounded SPSC rings.
+  batch_n = std::max(batch_n, 1); // a batch of 0 would never move an item
+  std::vector<spsc_ring_t<pipeline_item_t> *> rings(stage_n + 1);
+  for (auto &ring : rings) {
+    ring = new spsc_ring_t<pipeline_item_t>(std::max(1024, batch_n * 4));
+  }
+
+  pipeline_sink_t sink(stage_n, item_n);
+
+  auto args = std::vector<args_stage_t>(stage_n + 2);
+  for (int i = 0; i < stage_n + 2; ++i) {
+    args[i] = {i == 0 ? nullptr : rings[i - 1], i == stage_n + 1 ? nullptr : rings[i],
+               item_n, batch_n, &sink};
+  }
+
+  auto threads = std::vector<pthread_t>(stage_n + 2);
+  Profile profile(__func__, stage_n, item_n, batch_n);
+  auto run_before = clk::now();
+  for (int i = 0; i < stage_n + 2; ++i) {
+    pthread_create(&threads[i], nullptr, f_stage, &args[i]);
+  }
+  for (auto tid : threads) {
+    pthread_join(tid, nullptr);
+  }
+  auto run_after = clk::now();
+  profile.stop();
+  auto run_duration = run_after - run_before;
+  auto run_us = std::chrono::duration_cast<us>(run_duration).count();
+
+  fmt::print("pass {} items through {} stages of threads in batches of {}, cost {} us, "
+             "{:.0f} items/s\n",
+             item_n, stage_n, batch_n, run_us, item_n * 1000000.0 / std::max<long>(run_us, 1));
+  sink.print(item_n);
+
+  for (auto ring : rings) {
+    delete ring;
+  }
+}
+
+// stack fault tests
+// Pre-faulted thread stacks, recycled across tests so that only the first test that
+// grows the pool pays for page faults. Used from the main thread only.
+struct stack_pool_t {
+  static const size_t stack_size = 256 * 1024;
+
+  char *get() {
+    if (!stacks.empty()) {
+      auto stack = stacks.back();
+      stacks.pop_back();
+      return stack;
+    }
+    auto page = sysconf(_SC_PAGESIZE);
+    auto region = static_cast<char *>(mmap(nullptr, stack_size + page, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0));
+    if (region == MAP_FAILED) {
+      throw std::runtime_error("mmap stack failed.\n");
+    }
+    mprotect(region, page, PROT_NONE); // guard page
+    memset(region + page, 0, stack_size);
+    return region + page;
+  }
+
+  void put(char *stack) { stacks.push_back(stack); }
+
+  std::vector<char *> stacks;
+};
+
+static stack_pool_t stack_pool;
+
+static void pthread_stack_fault_test(int thread_n, bool prefault) {
+  std::vector<char *> stacks;
+  std::vector<pthread_attr_t> attrs(thread_n);
+  size_t stack_size = 0;
+  if (prefault) {
+    auto pool_before = Utils::minor_faults();
+    for (auto &attr : attrs) {
+      stacks.push_back(stack_pool.get());
+      pthread_attr_init(&attr);
+      pthread_attr_setstack(&attr, stacks.back(), stack_pool_t::stack_size);
+    }
+    stack_size = stack_pool_t::stack_size;
+    fmt::print("take {} stacks from pool, {} minor faults\n", thread_n,
+               Utils::minor_faults() - pool_before);
+  } else {
+    for (auto &attr : attrs) {
+      pthread_attr_init(&attr);
+    }
+    pthread_attr_getstacksize(&attrs[0], &stack_size);
+  }
+  std::vector<stack_probe_t> probes(thread_n, stack_probe_t{stack_size, 0});
+
+  std::vector<pthread_t> threads(thread_n);
+  Profile profile(__func__, thread_n, prefault);
+  auto create_faults = Utils::minor_faults();
+  auto create_before = clk::now();
+  for (int i = 0; i < thread_n; ++i) {
+    pthread_create(&threads[i], &attrs[i], Utils::f_touch_stack, &probes[i]);
+  }
+  auto create_after = clk::now();
+  create_faults = Utils::minor_faults() - create_faults;
+  auto create_us = std::chrono::duration_cast<us>(create_after - create_before).count();
+
+  auto join_faults = Utils::minor_faults();
+  TRACE(__func__, block, 0);
+  auto join_before = clk::now();
+  for (auto tid : threads) {
+    pthread_join(tid, nullptr);
+  }
+  auto join_after = clk::now();
+  TRACE(__func__, wake, 0);
+  profile.stop();
+  join_faults = Utils::minor_faults() - join_faults;
+  auto join_us = std::chrono::duration_cast<us>(join_after - join_before).count();
+
+  fmt::print("create {} threads on {} stacks, cost {} us, {} minor faults\n", thread_n,
+             prefault ? "pre-faulted" : "default", create_us, create_faults);
+  fmt::print("join {} threads, cost {} us, {} minor faults\n", thread_n, join_us,
+             join_faults);
+  fmt::print("{:.1f} minor faults per thread, {} stack pages resident per thread\n",
+             double(create_faults + join_faults) / thread_n, Utils::avg_stack_pages(probes));
+
+  for (auto &attr : attrs) {
+    pthread_attr_destroy(&attr);
+  }
+  for (auto stack : stacks) {
+    stack_pool.put(stack);
+  }
+}
+
+// tls tests
+struct args_tls_t {
+  uint64_t value;
+  int migrate_n;
+  uint64_t access_n;
+  tls_stat_t thread_local_stat;
+  tls_stat_t pthread_specific_stat;
+};
+
+static void *f_tls(void *args) {
+  auto args_tls = static_cast<args_tls_t *>(args);
+  auto yield = []() { sched_yield(); };
+  for (int i = 0; i < args_tls->migrate_n; ++i) {
+    args_tls->thread_local_stat.round(thread_local_storage_t{}, args_tls->value,
+                                      args_tls->access_n, yield);
+    args_tls->pthread_specific_stat.round(pthread_specific_storage_t{}, args_tls->value,
+                                          args_tls->access_n, yield);
+  }
+  return nullptr;
+}
+
+static void pthread_tls_test(int thread_n, int migrate_n, uint64_t access_n) {
+  auto args = std::vector<args_tls_t>(thread_n);
+  for (int i = 0; i < thread_n; ++i) {
+    args[i].value = i + 1;
+    args[i].migrate_n = migrate_n;
+    args[i].access_n = access_n;
+  }
+
+  Profile profile(__func__, thread_n, migrate_n, access_n);
+  auto threads = std::vector<pthread_t>(thread_n);
+  for (int i = 0; i < thread_n; ++i) {
+    pthread_create(&threads[i], nullptr, f_tls, &args[i]);
+  }
+  for (auto tid : threads) {
+    pthread_join(tid, nullptr);
+  }
+  profile.stop();
+
+  tls_stat_t thread_local_stat, pthread_specific_stat;
+  for (auto &arg : args) {
+    thread_local_stat.merge(arg.thread_local_stat);
+    pthread_specific_stat.merge(arg.pthread_specific_stat);
+  }
+  fmt::print("launch {} threads, yield {} times between {} accesses:\n", thread_n, migrate_n,
+             access_n);
+  thread_local_stat.print("thread_local");
+  pthread_specific_stat.print("pthread_getspecific");
+}
+
+// queue tests
+template <typename Queue> struct args_queue_t {
+  Queue *queue;
+  uint64_t item_begin;
+  uint64_t item_end; // producers push [item_begin, item_end)
+  uint64_t item_n;   // consumers pop until item_n items are consumed in total
+  int batch_n;
+  std::atomic<uint64_t> *consumed;
+  uint64_t sum;
+};
+
+template <typename Queue> static void *f_producer(void *args) {
+  auto args_queue = static_cast<args_queue_t<Queue> *>(args);
+  auto batch = std::vector<uint64_t>(args_queue->batch_n);
+  for (auto item = args_queue->item_begin; item < args_queue->item_end;) {
+    auto n = std::min<uint64_t>(args_queue->batch_n, args_queue->item_end - item);
+    for (size_t i = 0; i < n; ++i) {
+      batch[i] = item + i;
+    }
+    size_t pushed = 0;
+    while ((pushed += args_queue->queue->push_n(batch.data() + pushed, n - pushed)) < n) {
+      sched_yield();
+    }
+    item += n;
+  }
+  return nullptr;
+}
+
+template <typename Queue> static void *f_consumer(void *args) {
+  auto args_queue = static_cast<args_queue_t<Queue> *>(args);
+  auto batch = std::vector<uint64_t>(args_queue->batch_n);
+  uint64_t sum = 0;
+  while (args_queue->consumed->load(std::memory_order_relaxed) < args_queue->item_n) {
+    auto n = args_queue->queue->pop_n(batch.data(), args_queue->batch_n);
+    if (n == 0) {
+      sched_yield();
+      continue;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      sum += batch[i];
+    }
+    args_queue->consumed->fetch_add(n, std::memory_order_relaxed);
+  }
+  args_queue->sum = sum;
+  return nullptr;
+}
+
+// the owner takes from its own queue like a worker running its local tasks: the owner's
+// end for the deque, pop for the others
+template <typename T> static bool pop_own(ws_deque_t<T> &deque, T &item) {
+  return deque.pop_local(item);
+}
+template <typename Queue, typename T> static bool pop_own(Queue &queue, T &item) {
+  return queue.pop(item);
+}
+
+// The owner pushes a batch and runs half of it itself, the rest is left to thieves; it
+// drains its queue when a push finds it full and after the last batch.
+template <typename Queue> static void *f_owner(void *args) {
+  auto args_queue = static_cast<args_queue_t<Queue> *>(args);
+  auto queue = args_queue->queue;
+  auto batch = std::vector<uint64_t>(args_queue->batch_n);
+  uint64_t sum = 0, item_own;
+  auto run_own = [&](uint64_t run_n) {
+    uint64_t ran_n = 0;
+    while (ran_n < run_n && pop_own(*queue, item_own)) {
+      sum += item_own;
+      ++ran_n;
+    }
+    args_queue->consumed->fetch_add(ran_n, std::memory_order_relaxed);
+    return ran_n;
+  };
+  for (auto item = args_queue->item_begin; item < args_queue->item_end;) {
+    auto n = std::min<uint64_t>(args_queue->batch_n, args_queue->item_end - item);
+    for (size_t i = 0; i < n; ++i) {
+      batch[i] = item + i;
+    }
+    size_t pushed = 0;
+    while ((pushed += queue->push_n(batch.data() + pushed, n - pushed)) < n) {
+      run_own(1);
+    }
+    item += n;
+    run_own((n + 1) / 2);
+  }
+  while (args_queue->consumed->load(std::memory_order_relaxed) < args_queue->item_n) {
+    if (run_own(args_queue->batch_n) == 0) {
+      sched_yield();
+    }
+  }
+  args_queue->sum = sum;
+  return nullptr;
+}
+
+// Return items/s, or 0 if the queue does not support this producer/consumer ratio. With
+// owner, the one producer is an f_owner and the consumers are thieves.
+template <typename Queue>
+static double queue_test(int producer_n, int consumer_n, uint64_t item_n, int batch_n,
+                         bool owner = false) {
+  auto taker_n = consumer_n + (owner ? 1 : 0);
+  if (producer_n > Queue::max_producer || taker_n > Queue::max_consumer) {
+    fmt::print("{}: skipped, {} producers and {} consumers not supported\n", Queue::name(),
+               producer_n, taker_n);
+    return 0;
+  }
+  // its batches would be as many single pops; an owner still pushes whole batches
+  if (!Queue::batch_pop && batch_n > 1 && !owner) {
+    fmt::print("{}: skipped, pops one item at a time, batches of {} would repeat batches "
+               "of 1\n",
+               Queue::name(), batch_n);
+    return 0;
+  }
+
+  Queue queue(4096);
+  std::atomic<uint64_t> consumed{0};
+  auto args = std::vector<args_queue_t<Queue>>(producer_n + consumer_n);
+  for (int i = 0; i < producer_n + consumer_n; ++i) {
+    args[i] = {&queue, item_n * i / producer_n, item_n * (i + 1) / producer_n, item_n,
+               batch_n, &consumed, 0};
+  }
+
+  Profile profile("pthread_queue_test", Queue::name(), producer_n, consumer_n, item_n,
+                  batch_n);
+  auto threads = std::vector<pthread_t>(producer_n + consumer_n);
+  auto run_before = clk::now();
+  for (int i = 0; i < producer_n + consumer_n; ++i) {
+    auto task = owner && i == 0 ? f_owner<Queue>
+                : i < producer_n ? f_producer<Queue>
+                                 : f_consumer<Queue>;
+    pthread_create(&threads[i], nullptr, task, &args[i]);
+  }
+  for (auto tid : threads) {
+    pthread_join(tid, nullptr);
+  }
+  auto run_after = clk::now();
+  profile.stop();
+  auto run_us = std::chrono::duration_cast<us>(run_after - run_before).count();
+
+  uint64_t sum = 0;
+  for (int i = owner ? 0 : producer_n; i < producer_n + consumer_n; ++i) {
+    sum += args[i].sum;
+  }
+  if (sum != item_n * (item_n - 1) / 2) {
+    fmt::print("{}: items lost or duplicated\n", Queue::name());
+  }
+
+  auto throughput = item_n * 1000000.0 / std::max<long>(run_us, 1);
+  fmt::print("{}: {} {}, {} {}, batches of {}{}, {} items cost {} us, {:.0f} items/s\n",
+             Queue::name(), producer_n, owner ? "owner" : "producers", consumer_n,
+             owner ? "thieves" : "consumers", batch_n,
+             Queue::batch_pop || batch_n == 1 ? "" : " (steals of 1)", item_n, run_us,
+             throughput);
+  return throughput;
+}
+
+// the queues for one point, print the fastest
+static void queue_point(int producer_n, int consumer_n, uint64_t item_n, int batch_n,
+                        bool owner) {
+  std::pair<double, const char *> results[] = {
+      {queue_test<mpmc_queue_t<uint64_t>>(producer_n, consumer_n, item_n, batch_n, owner),
+       mpmc_queue_t<uint64_t>::name()},
+      {queue_test<ws_deque_t<uint64_t>>(producer_n, consumer_n, item_n, batch_n, owner),
+       ws_deque_t<uint64_t>::name()},
+      {queue_test<spsc_ring_t<uint64_t>>(producer_n, consumer_n, item_n, batch_n, owner),
+       spsc_ring_t<uint64_t>::name()},
+      {queue_test<mutex_queue_t<uint64_t>>(producer_n, consumer_n, item_n, batch_n, owner),
+       mutex_queue_t<uint64_t>::name()},
+  };
+  auto best = *std::max_element(std::begin(results), std::end(results));
+  if (owner) {
+    fmt::print("fastest queue for 1 owner and {} thieves, batches of {}: {}\n", consumer_n,
+               batch_n, best.second);
+  } else {
+    fmt::print("fastest queue for {} producers and {} consumers, batches of {}: {}\n",
+               producer_n, consumer_n, batch_n, best.second);
+  }
+}
+
+// Candidates for the task queue of the in-repo executors: the fastest one for every
+// producer/consumer split of the CPUs (at least 2 threads) and the given one, at batches
+// of 1, batch_n and 64; then with an owner popping its own queue and the others stealing,
+// the pattern of a work-stealing worker.
+static void pthread_queue_test(int producer_n, int consumer_n, uint64_t item_n,
+                               int batch_n) {
+  auto thread_n = std::max(Utils::cpu_count(), 2);
+  std::vector<std::pair<int, int>> splits{{producer_n, consumer_n}};
+  for (auto split_producer_n : {1, thread_n / 2, thread_n - 1}) {
+    splits.emplace_back(split_producer_n, thread_n - split_producer_n);
+  }
+  std::sort(splits.begin(), splits.end());
+  splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+  std::vector<int> batches{1, std::max(batch_n, 1), 64};
+  std::sort(batches.begin(), batches.end());
+  batches.erase(std::unique(batches.begin(), batches.end()), batches.end());
+
+  for (auto batch : batches) {
+    for (auto &split : splits) {
+      queue_point(split.first, split.second, item_n, batch, false);
+    }
+  }
+  for (auto batch : batches) {
+    for (auto thief_n : {0, thread_n - 1}) {
+      queue_point(1, thief_n, item_n, batch, true);
+    }
+  }
+}
+
+static void pthread_hybrid_test(int thread_n, uint64_t switch_n) {
+  fmt::print("Not Implemented, cpp20co runs hybrid tests on the in-repo thread pool.\n");
+}
+
+// Every round starts a new pool, so every round is a cold start.
+static void pthread_lifecycle_test(int worker_n) {
+  for (int round = 0; round < 3; ++round) {
+    thread_pool_t pool;
+    Profile profile(__func__, worker_n, round);
+    auto startup = pool.start(worker_n);
+    auto shutdown = pool.stop();
+    profile.stop();
+    fmt::print("round {}: start a pool of {} threads, first task after {} us, stop cost {} "
+               "us\n",
+               round, worker_n, std::chrono::duration_cast<us>(startup).count(),
+               std::chrono::duration_cast<us>(shutdown).count());
+  }
+}
+
+// Threads have exited before the join is timed; the join still waits for the tail of
+// each exit and hands its stack back to glibc's stack cache.
+static void pthread_teardown_test(int thread_n, int repeat_n) {
+  std::vector<pthread_t> threads(thread_n);
+  reclaim_stat_t stat(repeat_n);
+  for (int round = 0; round < repeat_n; ++round) {
+    std::atomic<int> done{0};
+    for (auto &tid : threads) {
+      pthread_create(&tid, nullptr, Utils::f_count, &done);
+    }
+    while (done.load() < thread_n) {
+      sched_yield();
+    }
+
+    Profile profile(__func__, thread_n, round);
+    auto destroy_before = clk::now();
+    for (auto tid : threads) {
+      pthread_join(tid, nullptr);
+    }
+    auto destroy_after = clk::now();
+    profile.stop();
+    stat.round(thread_n, destroy_after - destroy_before);
+  }
+  stat.print();
+}
+
+// Tasks run on the in-repo pool, whose idle workers sleep on a condition variable.
+static void pthread_oversubscribe_test(int task_n, uint64_t work_n) {
+  oversubscribe_sweep(task_n, work_n, [=](int worker_n, oversubscribe_run_t &point) {
+    thread_pool_t pool(worker_n);
+    Profile profile("pthread_oversubscribe_test", task_n, worker_n);
+    point.start();
+    for (int i = 0; i < task_n; ++i) {
+      pool.post(Utils::f_spin, point.submit(i));
+    }
+    pool.stop();
+    point.stop();
+    profile.stop();
+    return true;
+  });
+}
+
+// join tests
+// std::latch for C++11: count_down() is one atomic decrement, only the last one takes
+// the mutex to wake the waiter.
+struct latch_t {
+  explicit latch_t(int count) : count(count) {}
+
+  void count_down() {
+    if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> guard(mutex);
+      done = true;
+      zero.notify_all();
+    }
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    zero.wait(lock, [this]() { return done; });
+  }
+
+  std::atomic<int> count;
+  std::mutex mutex;
+  std::condition_variable zero;
+  bool done = false;
+};
+
+static void *f_count_down(void *latch) {
+  static_cast<latch_t *>(latch)->count_down();
+  return nullptr;
+}
+
+static void pthread_join_test(int max_n) {
+  pthread_attr_t detached;
+  pthread_attr_init(&detached);
+  pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+
+  // exited threads hold their resources until joined, there is a limit on how many
+  bool joinable = true;
+  for (auto thread_n : Utils::join_sizes(max_n)) {
+    std::vector<pthread_t> threads(thread_n);
+    if (joinable) {
+      Profile profile(__func__, "pthread_join", thread_n);
+      auto launch_before = clk::now();
+      int created = 0;
+      for (auto &tid : threads) {
+        if (pthread_create(&tid, nullptr, Utils::f_null, nullptr) != 0) {
+          break;
+        }
+        ++created;
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      for (int i = 0; i < created; ++i) {
+        pthread_join(threads[i], nullptr);
+      }
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      if (created < thread_n) {
+        fmt::print("can't keep {} joinable threads, pthread_join stops at {}\n", thread_n,
+                   created);
+        joinable = false;
+      } else {
+        Utils::print_join("pthread_join", thread_n, join_before - launch_before,
+                          join_after - join_before);
+      }
+    }
+    {
+      latch_t latch(thread_n);
+      Profile profile(__func__, "latch", thread_n);
+      auto launch_before = clk::now();
+      for (auto &tid : threads) {
+        while (pthread_create(&tid, &detached, f_count_down, &latch) != 0) {
+          sched_yield();
+        }
+      }
+      TRACE(__func__, block, 0);
+      auto join_before = clk::now();
+      latch.wait();
+      auto join_after = clk::now();
+      TRACE(__func__, wake, 0);
+      profile.stop();
+      Utils::print_join("latch", thread_n, join_before - launch_before,
+                        join_after - join_before);
+    }
+  }
+  pthread_attr_destroy(&detached);
+}
+
+static void pthread_false_sharing_test(int thread_n, uint64_t write_n) {
+  false_sharing_sweep(__func__, thread_n, write_n, [=](std::vector<sharing_args_t> &args) {
+    std::vector<pthread_t> threads(thread_n);
+    for (int i = 0; i < thread_n; ++i) {
+      pthread_create(&threads[i], nullptr, Utils::f_write, &args[i]);
+    }
+    for (auto tid : threads) {
+      pthread_join(tid, nullptr);
+    }
+  });
+}
+
+// allocation tests
+static void f_yield() { sched_yield(); }
+
+static void pthread_alloc_test(int thread_n, uint64_t alloc_n) {
+  alloc_run_t run(thread_n, alloc_n);
+  std::vector<args_alloc_t> args(thread_n);
+  for (int i = 0; i < thread_n; ++i) {
+    args[i] = {&run.tasks[i], &run.exchange};
+  }
+  std::vector<pthread_t> threads(thread_n);
+
+  Profile profile(__func__, thread_n, alloc_n);
+  run.start();
+  for (int i = 0; i < thread_n; ++i) {
+    pthread_create(&threads[i], nullptr, f_alloc<f_yield>, &args[i]);
+  }
+  for (auto tid : threads) {
+    pthread_join(tid, nullptr);
+  }
+  run.stop();
+  profile.stop();
+  run.print(thread_n);
+}
+
+// scatter-gather tests: sub-tasks sleep on a condition variable that the cancel wakes,
+// the request waits on another one until its deadline
+struct pthread_request_t : scatter_request_t {
+  using scatter_request_t::scatter_request_t;
+  std::mutex mutex;
+  std::condition_variable sleeping;
+  std::condition_variable gathered;
+  bool cancelled = false;
+};
+
+static void *f_scatter(void *args) {
+  auto args_scatter = static_cast<args_scatter_t *>(args);
+  auto request = static_cast<pthread_request_t *>(args_scatter->request);
+  auto latency = request->latencies[args_scatter->index];
+  TRACE("scatter_sub_task", start, args_scatter);
+  std::unique_lock<std::mutex> lock(request->mutex);
+  if (request->sleeping.wait_for(lock, latency, [request] { return request->cancelled; })) {
+    ++request->cancelled_n;
+  }
+  ++request->finished_n;
+  request->gathered.notify_one();
+  TRACE("scatter_sub_task", finish, args_scatter);
+  return nullptr;
+}
+
+static void pthread_scatter_gather_test(int request_n, int fanout_k, uint64_t deadline_us) {
+  // sub-tasks block their worker, give each one of a request its own
+  thread_pool_t pool(fanout_k);
+  auto deadline = us(deadline_us);
+  for (auto k : scatter_stat_t::fanouts(fanout_k)) {
+    scatter_stat_t stat(k);
+    std::mt19937_64 random(k);
+    Profile profile(__func__, k, deadline_us);
+    for (int i = 0; i < request_n; ++i) {
+      pthread_request_t request(k, deadline, random);
+      std::vector<args_scatter_t> args(k);
+      auto request_before = clk::now();
+      for (int j = 0; j < k; ++j) {
+        args[j] = {&request, j};
+        pool.post(f_scatter, &args[j]);
+      }
+      TRACE(__func__, block, &request);
+      std::unique_lock<std::mutex> lock(request.mutex);
+      auto all_finished = [&request, k] { return request.finished_n == k; };
+      auto missed = !request.gathered.wait_until(lock, request_before + deadline, all_finished);
+      auto request_after = clk::now();
+      TRACE(__func__, wake, &request);
+      if (missed) {
+        request.cancelled = true;
+        request.sleeping.notify_all();
+        request.gathered.wait(lock, all_finished);
+      }
+      auto cancel_after = clk::now();
+      stat.round(request_after - request_before, missed, cancel_after - request_after,
+                 request.cancelled_n);
+    }
+    profile.stop();
+    stat.print(deadline);
+  }
+}
+
+// inline tests
+struct pthread_backend_t {
+  using handle_t = pthread_t;
+  static const char *name() { return "pthread"; }
+
+  template <typename Body> static pthread_t spawn(Body, int *data) {
+    pthread_t tid;
+    pthread_create(&tid, nullptr, f_body<Body>, data);
+    return tid;
+  }
+
+  static void join(pthread_t &tid) { pthread_join(tid, nullptr); }
+
+  // on the calling thread, a yield switches it out and in as in ctx_switch_test_1
+  template <typename Body> static ns switch_loop(Body body, int *data, uint64_t switch_n) {
+    auto switch_before = clk::now();
+    while (switch_n--) {
+      body(data);
+      sched_yield();
+    }
+    return std::chrono::duration_cast<ns>(clk::now() - switch_before);
+  }
+};
+
+static void pthread_inline_test(int thread_n, uint64_t switch_n) {
+  inline_tests<pthread_backend_t>(thread_n, switch_n);
+}
+
 Benchmark benchmark{
     pthread_create_join_test,  pthread_loop_test_1,       pthread_loop_test_2,
     pthread_ctx_switch_test_1, pthread_ctx_switch_test_2, pthread_long_callback_test,
+    pthread_pipeline_test,     pthread_stack_fault_test,  pthread_tls_test,
+    pthread_queue_test,        pthread_hybrid_test,       pthread_lifecycle_test,
+    pthread_teardown_test,     pthread_oversubscribe_test, pthread_join_test,
+    pthread_false_sharing_test, pthread_alloc_test, pthread_scatter_gather_test,
+    pthread_inline_test,
 };
\ No newline at end of file